@@ -0,0 +1,148 @@
+#include <gnt.h>
+#include <gnttextview.h>
+
+#include "bench.h"
+
+#define WIDTH   100
+#define HEIGHT  40
+#define SCROLLS 1000
+#define REDRAWS 100
+
+static const gsize sizes[] = {10000, 100000, 1000000};
+
+/* Long enough to wrap at the narrower width used for the reflow. */
+static const char text[] =
+	"The quick brown fox jumps over the lazy dog, "
+	"while the lazy dog dreams of chasing the quick brown fox.";
+
+static void
+fill(GntTextView *view, gsize lines)
+{
+	gsize i;
+
+	for (i = 0; i < lines; i++) {
+		char line[160];
+
+		g_snprintf(line, sizeof(line), "%" G_GSIZE_FORMAT ": %s\n", i, text);
+		gnt_text_view_append_text_with_flags(view, line,
+		        i % 4 ? GNT_TEXT_FLAG_NORMAL : GNT_TEXT_FLAG_BOLD);
+	}
+}
+
+/* Append @lines lines of the same 39 bytes, each in @segments parts with
+ * alternating formats. The heap the view grows by, over the number of lines,
+ * is what a line costs with its text. */
+static void
+run_append(const char *name, gsize lines, gsize segments)
+{
+	static const char line[] = "The quick brown fox jumps over the lazy";
+	GntWidget *view, *window;
+	gchar **pieces = g_new(gchar *, segments);
+	gsize i, s;
+
+	for (s = 0; s < segments; s++) {
+		gsize from = (sizeof(line) - 1) * s / segments;
+		gsize to = (sizeof(line) - 1) * (s + 1) / segments;
+
+		pieces[s] = g_strdup_printf("%.*s%s", (int)(to - from), line + from,
+		        s == segments - 1 ? "\n" : "");
+	}
+
+	view = gnt_text_view_new();
+	gnt_text_view_set_scrollback(GNT_TEXT_VIEW(view), 0, 0);
+	gnt_widget_set_size(view, WIDTH, HEIGHT);
+	window = bench_window_new(view);
+
+	bench_start();
+	for (i = 0; i < lines; i++) {
+		for (s = 0; s < segments; s++) {
+			gnt_text_view_append_text_with_flags(GNT_TEXT_VIEW(view), pieces[s],
+			        s % 2 ? GNT_TEXT_FLAG_BOLD : GNT_TEXT_FLAG_NORMAL);
+		}
+	}
+	bench_flush();
+	bench_stop(name, lines, lines);
+
+	gnt_widget_destroy(window);
+	bench_flush();
+	for (s = 0; s < segments; s++)
+		g_free(pieces[s]);
+	g_free(pieces);
+}
+
+static void
+run(gsize lines)
+{
+	GntWidget *view, *window;
+	gsize i;
+	int step;
+	gint x, y;
+
+	view = gnt_text_view_new();
+	gnt_text_view_set_scrollback(GNT_TEXT_VIEW(view), 0, 0);
+	gnt_widget_set_size(view, WIDTH, HEIGHT);
+	window = bench_window_new(view);
+
+	bench_start();
+	fill(GNT_TEXT_VIEW(view), lines);
+	bench_flush();
+	bench_stop("append", lines, lines);
+
+	/* A page at a time, up from the bottom and back down at the top,
+	 * drawing each page. A positive step scrolls down. */
+	bench_start();
+	for (i = 0, step = -HEIGHT; i < SCROLLS; i++) {
+		if (step < 0 && gnt_text_view_get_lines_above(GNT_TEXT_VIEW(view)) == 0)
+			step = HEIGHT;
+		else if (step > 0 && gnt_text_view_get_lines_below(GNT_TEXT_VIEW(view)) == 0)
+			step = -HEIGHT;
+		gnt_text_view_scroll(GNT_TEXT_VIEW(view), step);
+		bench_flush();
+	}
+	bench_stop("scroll", lines, SCROLLS);
+
+	/* Draw the bottom page, then select all of it the way the mouse does
+	 * and draw it again. Drawing the highlight allocates nothing, so both
+	 * should make as many allocations. */
+	gnt_text_view_scroll(GNT_TEXT_VIEW(view), 0);
+	bench_flush();
+	bench_start();
+	for (i = 0; i < REDRAWS; i++) {
+		gnt_widget_draw(view);
+		bench_flush();
+	}
+	bench_stop("draw", lines, REDRAWS);
+
+	gnt_widget_get_position(view, &x, &y);
+	gnt_widget_clicked(view, GNT_LEFT_MOUSE_DOWN, x, y);
+	gnt_widget_clicked(view, GNT_MOUSE_UP, x + WIDTH - 2, y + HEIGHT - 1);
+	bench_flush();
+	bench_start();
+	for (i = 0; i < REDRAWS; i++) {
+		gnt_widget_draw(view);
+		bench_flush();
+	}
+	bench_stop("draw-selected", lines, REDRAWS);
+
+	bench_start();
+	gnt_screen_resize_widget(window, WIDTH / 2, HEIGHT);
+	bench_flush();
+	gnt_screen_resize_widget(window, WIDTH, HEIGHT);
+	bench_flush();
+	bench_stop("reflow", lines, 2);
+
+	gnt_widget_destroy(window);
+	bench_flush();
+}
+
+void
+bench_textview(void)
+{
+	gsize i;
+
+	for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+		run_append("append-1-segment", sizes[i], 1);
+		run_append("append-3-segments", sizes[i], 3);
+		run(sizes[i]);
+	}
+}
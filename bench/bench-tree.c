@@ -0,0 +1,149 @@
+#include <gnt.h>
+#include <gntkeys.h>
+#include <gnttree.h>
+
+#include "bench.h"
+
+#define WIDTH    100
+#define HEIGHT   40
+#define SEARCHES 100
+
+static const gsize sizes[] = {1000, 10000, 100000, 500000};
+
+static gint
+compare_keys(gconstpointer a, gconstpointer b)
+{
+	return GPOINTER_TO_INT(a) - GPOINTER_TO_INT(b);
+}
+
+/* The keys 1 to @count, in an order that is random but the same each run. */
+static gint *
+shuffled_keys(gsize count)
+{
+	GRand *rand = g_rand_new_with_seed(count);
+	gint *keys = g_new(gint, count);
+	gsize i;
+
+	for (i = 0; i < count; i++)
+		keys[i] = i + 1;
+	for (i = count - 1; i > 0; i--) {
+		gsize j = g_rand_int_range(rand, 0, i + 1);
+		gint swap = keys[i];
+		keys[i] = keys[j];
+		keys[j] = swap;
+	}
+	g_rand_free(rand);
+
+	return keys;
+}
+
+static GntTreeRow *
+create_row(GntTree *tree, gint key)
+{
+	char name[32], value[32];
+
+	g_snprintf(name, sizeof(name), "row %d", key);
+	g_snprintf(value, sizeof(value), "%x", key * 2654435761u);
+	return gnt_tree_create_row(tree, name, value);
+}
+
+static GntWidget *
+new_tree(GntWidget **window, gboolean sorted)
+{
+	GntWidget *tree = gnt_tree_new_with_columns(2);
+
+	if (sorted)
+		gnt_tree_set_compare_func(GNT_TREE(tree), compare_keys);
+	gnt_widget_set_size(tree, WIDTH, HEIGHT);
+	*window = bench_window_new(tree);
+
+	return tree;
+}
+
+static void
+type(GntWidget *tree, const char *text)
+{
+	for (; *text; text++) {
+		char key[2] = {*text, '\0'};
+
+		gnt_widget_key_pressed(tree, key);
+		bench_flush();
+	}
+}
+
+static void
+run(gsize rows)
+{
+	GntWidget *tree, *window;
+	gint *keys = shuffled_keys(rows);
+	gsize i, ops;
+
+	tree = new_tree(&window, FALSE);
+	bench_start();
+	for (i = 0; i < rows; i++) {
+		gnt_tree_add_row_last(GNT_TREE(tree), GINT_TO_POINTER(i + 1),
+		        create_row(GNT_TREE(tree), i + 1), NULL);
+	}
+	bench_flush();
+	bench_stop("insert", rows, rows);
+	gnt_widget_destroy(window);
+
+	tree = new_tree(&window, TRUE);
+	bench_start();
+	gnt_tree_begin_batch(GNT_TREE(tree));
+	for (i = 0; i < rows; i++) {
+		gnt_tree_add_row_after(GNT_TREE(tree), GINT_TO_POINTER(keys[i]),
+		        create_row(GNT_TREE(tree), keys[i]), NULL, NULL);
+	}
+	gnt_tree_end_batch(GNT_TREE(tree));
+	bench_flush();
+	bench_stop("sort-batch", rows, rows);
+	gnt_widget_destroy(window);
+
+	tree = new_tree(&window, TRUE);
+	bench_start();
+	for (i = 0; i < rows; i++) {
+		gnt_tree_add_row_after(GNT_TREE(tree), GINT_TO_POINTER(keys[i]),
+		        create_row(GNT_TREE(tree), keys[i]), NULL, NULL);
+	}
+	bench_flush();
+	bench_stop("sort", rows, rows);
+
+	/* Type a search, a key at a time, and take it back. */
+	bench_start();
+	gnt_bindable_perform_action_named(GNT_BINDABLE(tree), "start-search", NULL);
+	for (i = 0, ops = 0; i < SEARCHES; i++) {
+		char text[16];
+		gsize len;
+
+		len = g_snprintf(text, sizeof(text), "row %d", keys[i % rows]);
+		type(tree, text);
+		for (ops += len; len; len--) {
+			gnt_widget_key_pressed(tree, GNT_KEY_BACKSPACE);
+			bench_flush();
+			ops++;
+		}
+	}
+	gnt_bindable_perform_action_named(GNT_BINDABLE(tree), "end-search", NULL);
+	bench_flush();
+	bench_stop("search", rows, ops);
+
+	bench_start();
+	for (i = 0; i < rows; i++)
+		gnt_tree_remove(GNT_TREE(tree), GINT_TO_POINTER(keys[i]));
+	bench_flush();
+	bench_stop("remove", rows, rows);
+
+	gnt_widget_destroy(window);
+	bench_flush();
+	g_free(keys);
+}
+
+void
+bench_tree(void)
+{
+	gsize i;
+
+	for (i = 0; i < G_N_ELEMENTS(sizes); i++)
+		run(sizes[i]);
+}
@@ -0,0 +1,56 @@
+#include <string.h>
+
+#include <gnt.h>
+#include <gntutils.h>
+
+#include "bench.h"
+
+#define REPEATS 100
+
+static const gsize sizes[] = {64, 4096, 65536};
+
+static const struct {
+	const char *name;
+	const char *text;
+} samples[] = {
+	{"onscreen-width-ascii", "The quick brown fox jumps over the lazy dog. "},
+	{"onscreen-width-cjk", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae"
+	                       "\xe6\x96\x87\xe7\xab\xa0\xe3\x81\xa8\xed\x95\x9c"
+	                       "\xea\xb5\xad\xec\x96\xb4 "},
+	{"onscreen-width-emoji", "\xf0\x9f\x98\x80\xf0\x9f\x8e\x89\xf0\x9f\x91\x8d"
+	                         "\xf0\x9f\x8f\xbd\xe2\x9d\xa4\xef\xb8\x8f\xf0\x9f"
+	                         "\x87\xaf\xf0\x9f\x87\xb5 "},
+};
+
+/* @sample repeated to about @size bytes, without cutting a character. */
+static gchar *
+repeat(const char *sample, gsize size)
+{
+	GString *text = g_string_sized_new(size + strlen(sample));
+
+	while (text->len < size)
+		g_string_append(text, sample);
+
+	return g_string_free(text, FALSE);
+}
+
+void
+bench_utils(void)
+{
+	gsize i, s;
+	int r;
+
+	for (i = 0; i < G_N_ELEMENTS(samples); i++) {
+		for (s = 0; s < G_N_ELEMENTS(sizes); s++) {
+			gchar *text = repeat(samples[i].text, sizes[s]);
+			volatile int width = 0;
+
+			bench_start();
+			for (r = 0; r < REPEATS; r++)
+				width += gnt_util_onscreen_width(text, NULL);
+			bench_stop(samples[i].name, strlen(text), REPEATS);
+
+			g_free(text);
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#include <gnt.h>
+#include <gntentry.h>
+#include <gntkeys.h>
+#include <gntlabel.h>
+#include <gntwm.h>
+
+#include "bench.h"
+
+#define FRAMES  200
+
+static const gsize key_counts[] = {10000, 100000};
+static const gsize window_counts[] = {1, 10, 50};
+
+/* Type into an entry, which goes through the window-manager, the window and
+ * the entry's own bindings. */
+static void
+run_input(GntWM *wm, gsize keys)
+{
+	GntWidget *window = bench_window_new(gnt_entry_new(NULL));
+	gsize i;
+
+	bench_start();
+	for (i = 0; i < keys; i++)
+		gnt_wm_process_input(wm, i % 2 ? GNT_KEY_BACKSPACE : "a");
+	bench_flush();
+	bench_stop("process-input", keys, keys);
+
+	gnt_widget_destroy(window);
+	bench_flush();
+}
+
+static void
+run_frames(GntWM *wm, gsize count)
+{
+	GntWidget **windows = g_new(GntWidget *, count);
+	GntWMFrameStats before, after;
+	GString *text = g_string_new(NULL);
+	gsize i, f;
+
+	for (i = 0; i < 18; i++)
+		g_string_append(text, "Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n");
+	g_string_truncate(text, text->len - 1);
+
+	/* Each window a little to the right of and below the one before. */
+	for (i = 0; i < count; i++) {
+		windows[i] = bench_window_new(gnt_label_new(text->str));
+		gnt_screen_move_widget(windows[i], (i * 2) % 80, i % 25);
+	}
+	bench_flush();
+
+	gnt_wm_get_frame_stats(wm, &before);
+	bench_start();
+	for (f = 0; f < FRAMES; f++) {
+		for (i = 0; i < count; i++)
+			gnt_widget_draw(windows[i]);
+		bench_flush();
+	}
+	gnt_wm_get_frame_stats(wm, &after);
+	bench_stop("redraw-frame", count, after.frames - before.frames);
+
+	gnt_wm_get_frame_stats(wm, &before);
+	bench_start();
+	for (f = 0; f < FRAMES; f++) {
+		gnt_wm_process_input(wm, "\033" "n");
+		bench_flush();
+	}
+	gnt_wm_get_frame_stats(wm, &after);
+	bench_stop("switch-window", count, after.frames - before.frames);
+
+	for (i = 0; i < count; i++)
+		gnt_widget_destroy(windows[i]);
+	bench_flush();
+	g_string_free(text, TRUE);
+	g_free(windows);
+}
+
+void
+bench_wm(void)
+{
+	GntWM *wm = gnt_wm_get_default();
+	gsize i;
+
+	for (i = 0; i < G_N_ELEMENTS(key_counts); i++)
+		run_input(wm, key_counts[i]);
+	for (i = 0; i < G_N_ELEMENTS(window_counts); i++)
+		run_frames(wm, window_counts[i]);
+}
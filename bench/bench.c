@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+#include <gnt.h>
+#include <gntbox.h>
+#include <gntwindow.h>
+
+#include "bench.h"
+
+/* Count the allocations by standing in for malloc and friends, which only
+ * works where the C library can be called underneath them. The sanitizers
+ * stand in for them too, so the build only asks for this without one. */
+#if defined(__GLIBC__) && defined(BENCH_COUNT_ALLOCATIONS)
+#define COUNT_ALLOCATIONS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static gsize allocations;
+
+void *
+malloc(size_t size)
+{
+	allocations++;
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+	allocations++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+#else
+#define COUNT_ALLOCATIONS 0
+
+static gsize allocations;
+#endif
+
+/* Bytes of the heap in use, which is only known from the C library. */
+#ifdef HAVE_MALLINFO2
+#define COUNT_HEAP 1
+
+static gsize
+heap_size(void)
+{
+	return mallinfo2().uordblks;
+}
+#else
+#define COUNT_HEAP 0
+
+static gsize
+heap_size(void)
+{
+	return 0;
+}
+#endif
+
+static const struct {
+	const char *name;
+	void (*run)(void);
+} suites[] = {
+	{"textview", bench_textview},
+	{"tree", bench_tree},
+	{"utils", bench_utils},
+	{"wm", bench_wm},
+};
+
+static const char *current_suite;
+static gboolean first_result = TRUE;
+
+static struct {
+	gint64 time;
+	gsize allocations;
+	gsize heap;
+} start;
+
+void
+bench_flush(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+void
+bench_start(void)
+{
+	start.allocations = allocations;
+	start.heap = heap_size();
+	start.time = g_get_monotonic_time();
+}
+
+void
+bench_stop(const char *name, gsize size, gsize ops)
+{
+	gint64 usec = g_get_monotonic_time() - start.time;
+	gsize count = allocations - start.allocations;
+	gssize heap = heap_size() - start.heap;
+
+	printf("%s\n\t\t{\"suite\": \"%s\", \"name\": \"%s\", "
+	       "\"size\": %" G_GSIZE_FORMAT ", \"ops\": %" G_GSIZE_FORMAT ", "
+	       "\"usec\": %" G_GINT64_FORMAT ", ",
+	       first_result ? "" : ",", current_suite, name, size, ops, usec);
+	if (COUNT_ALLOCATIONS) {
+		printf("\"allocations\": %" G_GSIZE_FORMAT ", ", count);
+	} else {
+		printf("\"allocations\": null, ");
+	}
+	if (COUNT_HEAP) {
+		printf("\"heap\": %" G_GSSIZE_FORMAT "}", heap);
+	} else {
+		printf("\"heap\": null}");
+	}
+	fflush(stdout);
+	first_result = FALSE;
+}
+
+GntWidget *
+bench_window_new(GntWidget *widget)
+{
+	GntWidget *window = gnt_window_new();
+
+	gnt_box_set_toplevel(GNT_BOX(window), TRUE);
+	gnt_box_set_title(GNT_BOX(window), "Benchmark");
+	gnt_box_add_widget(GNT_BOX(window), widget);
+	gnt_widget_show(window);
+	bench_flush();
+
+	return window;
+}
+
+static gboolean
+wanted(const char *suite, int argc, char **argv)
+{
+	int i;
+
+	if (argc < 2)
+		return TRUE;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], suite) == 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+int
+main(int argc, char **argv)
+{
+	gsize i;
+	int arg;
+
+	for (arg = 1; arg < argc; arg++) {
+		for (i = 0; i < G_N_ELEMENTS(suites); i++) {
+			if (strcmp(argv[arg], suites[i].name) == 0)
+				break;
+		}
+		if (i == G_N_ELEMENTS(suites)) {
+			fprintf(stderr, "Unknown benchmark suite: %s\n", argv[arg]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Draw into an offscreen screen, and keep the user's gntrc out of
+	 * the results. */
+	g_setenv("GNT_HEADLESS", "160x50", FALSE);
+	gnt_set_config_dir(".");
+	gnt_init();
+
+	printf("{\n\t\"benchmarks\": [");
+	for (i = 0; i < G_N_ELEMENTS(suites); i++) {
+		if (!wanted(suites[i].name, argc, argv))
+			continue;
+		current_suite = suites[i].name;
+		suites[i].run();
+	}
+	printf("\n\t]\n}\n");
+
+	gnt_quit();
+
+	return EXIT_SUCCESS;
+}
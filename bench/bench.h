@@ -0,0 +1,27 @@
+#ifndef GNT_BENCH_H
+#define GNT_BENCH_H
+
+#include <glib.h>
+
+#include <gnt.h>
+
+/* Run everything that is ready in the main loop, which includes drawing the
+ * widgets and the frame. */
+void bench_flush(void);
+
+/* Time the code between these, and print the result. @size is the size of
+ * the data the benchmark works on, and @ops the number of operations done on
+ * it in that time. Where the C library allows it, the result also has the
+ * number of allocations made, and by how many bytes the heap grew. */
+void bench_start(void);
+void bench_stop(const char *name, gsize size, gsize ops);
+
+/* A shown window with @widget in it. */
+GntWidget *bench_window_new(GntWidget *widget);
+
+void bench_textview(void);
+void bench_tree(void);
+void bench_utils(void);
+void bench_wm(void);
+
+#endif /* GNT_BENCH_H */
@@ -819,6 +819,8 @@ void gnt_box_sync_children(GntBox *box)
 	GList *iter;
 	gint widgetx, widgety, widgetwidth, widgetheight;
 	int pos;
+	gboolean damaged;
+	gint dx, dy, dwidth, dheight;
 
 	g_return_if_fail(GNT_IS_BOX(box));
 	priv = gnt_box_get_instance_private(box);
@@ -829,6 +831,10 @@ void gnt_box_sync_children(GntBox *box)
 	gnt_widget_get_internal_size(widget, &widgetwidth, &widgetheight);
 	pos = gnt_widget_get_has_border(widget) ? 1 : 0;
 
+	/* Whatever is damaged in the box itself is copied from the children, on
+	 * top of what they damaged of their own. */
+	damaged = gnt_widget_get_damage(widget, &dx, &dy, &dwidth, &dheight);
+
 	if (!priv->active) {
 		find_focusable_widget(box);
 	}
@@ -837,7 +843,8 @@ void gnt_box_sync_children(GntBox *box)
 		GntWidget *w = GNT_WIDGET(iter->data);
 		WINDOW *wwin;
 		int height, width;
-		gint x, y;
+		gint x, y, oldx, oldy;
+		gint cx, cy, cwidth, cheight;
 
 		if (G_UNLIKELY(w == NULL)) {
 			g_warn_if_reached();
@@ -855,6 +862,8 @@ void gnt_box_sync_children(GntBox *box)
 		gnt_widget_get_position(w, &x, &y);
 		x -= widgetx;
 		y -= widgety;
+		oldx = x;
+		oldy = y;
 
 		if (priv->vertical) {
 			x = pos;
@@ -878,9 +887,27 @@ void gnt_box_sync_children(GntBox *box)
 			}
 		}
 
+		/* Only the damaged part of the child is copied, unless it moved */
+		if (x != oldx || y != oldy) {
+			gnt_widget_damage_all(w);
+		}
+		if (damaged) {
+			gnt_widget_damage(w, dx - x, dy - y, dwidth, dheight);
+		}
+		if (gnt_widget_get_damage(w, &cx, &cy, &cwidth, &cheight)) {
+			cwidth = MIN(cwidth, width - cx);
+			cheight = MIN(cheight, height - cy);
+		} else {
+			cwidth = cheight = 0;
+		}
+		gnt_widget_clear_damage(w);
+
 		wwin = gnt_widget_get_window(w);
-		copywin(wwin, widget_window, 0, 0, y, x, y + height - 1,
-		        x + width - 1, FALSE);
+		if (cwidth > 0 && cheight > 0) {
+			copywin(wwin, widget_window, cy, cx, y + cy, x + cx,
+			        y + cy + cheight - 1, x + cx + cwidth - 1, FALSE);
+			gnt_widget_damage(widget, x + cx, y + cy, cwidth, cheight);
+		}
 		gnt_widget_set_position(w, x + widgetx, y + widgety);
 		if (w == priv->active) {
 			wmove(widget_window, y + getcury(wwin),
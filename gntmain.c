@@ -90,6 +90,9 @@ static gboolean ascii_only;
 static gboolean mouse_enabled;
 
 static void setup_io(void);
+#ifndef _WIN32
+static void process_keys(char *keys, gssize rd);
+#endif
 
 static gboolean refresh_screen(void);
 
@@ -100,6 +103,17 @@ int gnt_need_conversation_to_locale;
 
 static gchar *custom_config_dir = NULL;
 
+/* Set up by gnt_init when GNT_HEADLESS is set in the environment. */
+static SCREEN *headless_screen = NULL;
+static FILE *headless_out = NULL;
+static FILE *headless_in = NULL;
+
+static struct {
+	gchar **lines;
+	guint next;
+	guint source;
+} headless_script;
+
 #define HOLDING_ESCAPE  (escape_stuff.timer != 0)
 
 static struct {
@@ -117,7 +131,7 @@ escape_timeout(G_GNUC_UNUSED gpointer data)
 void
 gnt_set_config_dir(const gchar *config_dir)
 {
-	if (channel) {
+	if (channel || headless_screen) {
 		gnt_warning("gnt_set_config_dir failed: %s",
 			"gnt already initialized");
 	}
@@ -372,8 +386,6 @@ io_invoke(GIOChannel *source, G_GNUC_UNUSED GIOCondition cond,
 #else
 	char keys[256];
 	gssize rd;
-	char *k;
-	char *cvrt = NULL;
 
 	if (gnt_wm_get_keypress_mode(wm) == GNT_KP_MODE_WAIT_ON_CHILD) {
 		return FALSE;
@@ -395,6 +407,20 @@ io_invoke(GIOChannel *source, G_GNUC_UNUSED GIOCondition cond,
 		raise(SIGABRT);
 	}
 
+	process_keys(keys, rd);
+	return TRUE;
+#endif
+}
+
+#ifndef _WIN32
+/* Process @rd bytes of input stored after the escape prefix in @keys, which
+ * must have room for the prefix and a terminating NUL. */
+static void
+process_keys(char *keys, gssize rd)
+{
+	char *k;
+	char *cvrt = NULL;
+
 	rd += HOLDING_ESCAPE;
 	if (HOLDING_ESCAPE) {
 		keys[0] = GNT_ESCAPE;
@@ -431,9 +457,8 @@ end:
 	if (wm)
 		gnt_wm_set_event_stack(wm, FALSE);
 	g_free(cvrt);
-	return TRUE;
-#endif
 }
+#endif
 
 static void
 setup_io()
@@ -464,6 +489,222 @@ setup_io()
 	g_io_channel_unref(channel);
 }
 
+#ifndef _WIN32
+/* Feed the next line of the input script, once everything queued by the
+ * previous one (including the frame it caused) has been handled. */
+static gboolean
+headless_script_step(G_GNUC_UNUSED gpointer data)
+{
+	char keys[256];
+	const gchar *line;
+	gchar *input;
+	gsize len, off;
+	gssize rd;
+
+	/* An escape at the end of the previous line is a key on its own. */
+	if (HOLDING_ESCAPE) {
+		g_source_remove(escape_stuff.timer);
+		escape_timeout(NULL);
+	}
+
+	do {
+		line = headless_script.lines[headless_script.next];
+		if (line == NULL) {
+			headless_script.source = 0;
+			gnt_bindable_perform_action_named(GNT_BINDABLE(wm), "wm-quit", NULL);
+			return FALSE;
+		}
+		headless_script.next++;
+	} while (*line == '#');
+
+	input = g_strcompress(line);
+	len = strlen(input);
+	for (off = 0; off < len; off += rd) {
+		rd = MIN(len - off, sizeof(keys) - 2);
+		memcpy(keys + HOLDING_ESCAPE, input + off, rd);
+		process_keys(keys, rd);
+	}
+	g_free(input);
+
+	return TRUE;
+}
+
+/* Without a script, the program quits as soon as it settles down. */
+static void
+headless_read_script(const char *filename)
+{
+	gchar *contents = NULL;
+	GError *error = NULL;
+
+	if (filename && *filename &&
+	    !g_file_get_contents(filename, &contents, NULL, &error)) {
+		gnt_warning("could not read the input script: %s", error->message);
+		g_error_free(error);
+	}
+
+	if (contents) {
+		headless_script.lines = g_strsplit(contents, "\n", -1);
+	} else {
+		headless_script.lines = g_new0(gchar *, 1);
+	}
+	headless_script.next = 0;
+	headless_script.source = g_idle_add_full(G_PRIORITY_LOW,
+	                                         headless_script_step, NULL, NULL);
+	g_free(contents);
+}
+
+static void
+headless_setup(const char *size)
+{
+	const char *terms[] = {"xterm", "vt100", NULL};
+	int width = 80, height = 24;
+	int i;
+
+	if (sscanf(size, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+		width = 80;
+		height = 24;
+	}
+
+	headless_out = fopen("/dev/null", "w");
+	headless_in = fopen("/dev/null", "r");
+	if (headless_out == NULL || headless_in == NULL) {
+		g_error("could not open /dev/null for the headless screen");
+	}
+
+	/* Use a known terminal, so the key sequences and the output do not
+	 * depend on where the program happens to run. */
+	for (i = 0; terms[i] && headless_screen == NULL; i++) {
+		headless_screen = newterm(terms[i], headless_out, headless_in);
+		if (headless_screen) {
+			g_setenv("TERM", terms[i], TRUE);
+		}
+	}
+	if (headless_screen == NULL) {
+		g_error("could not set up a headless screen");
+	}
+	resizeterm(height, width);
+}
+
+static void
+headless_dump_screen(const char *filename)
+{
+	gchar *text = gnt_screen_get_text();
+	GError *error = NULL;
+
+	if (!g_file_set_contents(filename, text, -1, &error)) {
+		gnt_warning("could not dump the screen: %s", error->message);
+		g_error_free(error);
+	}
+	g_free(text);
+}
+#endif
+
+/* Line drawing characters are kept as the codes of the alternate character
+ * set, which are unreadable as text. */
+static gunichar
+acs_to_unichar(gunichar ch)
+{
+	switch (ch) {
+		case 'j': return 0x2518;
+		case 'k': return 0x2510;
+		case 'l': return 0x250C;
+		case 'm': return 0x2514;
+		case 'n': return 0x253C;
+		case 'q': return 0x2500;
+		case 't': return 0x251C;
+		case 'u': return 0x2524;
+		case 'v': return 0x2534;
+		case 'w': return 0x252C;
+		case 'x': return 0x2502;
+		case 'a': return 0x2592;
+		case '`': return 0x25C6;
+		case '~': return 0x00B7;
+		default:  return ch;
+	}
+}
+
+gboolean
+gnt_is_headless(void)
+{
+	return headless_screen != NULL;
+}
+
+gboolean
+gnt_screen_get_cell(int x, int y, gunichar *ch, attr_t *attr)
+{
+	g_return_val_if_fail(curscr != NULL, FALSE);
+
+	if (x < 0 || y < 0 || x >= getmaxx(curscr) || y >= getmaxy(curscr)) {
+		return FALSE;
+	}
+
+#if NCURSES_WIDECHAR
+	{
+		cchar_t cell;
+		wchar_t wch[CCHARW_MAX + 1];
+		attr_t a;
+		short pair;
+
+		if (mvwin_wch(curscr, y, x, &cell) != OK ||
+		    getcchar(&cell, wch, &a, &pair, NULL) == ERR) {
+			return FALSE;
+		}
+		if (ch) {
+			*ch = wch[0] ? (gunichar)wch[0] : ' ';
+			if (a & A_ALTCHARSET) {
+				*ch = acs_to_unichar(*ch);
+			}
+		}
+		if (attr) {
+			*attr = (a & ~A_COLOR) | COLOR_PAIR(pair);
+		}
+	}
+#else
+	{
+		chtype cell = mvwinch(curscr, y, x);
+
+		if (ch) {
+			*ch = cell & A_CHARTEXT;
+			if (cell & A_ALTCHARSET) {
+				*ch = acs_to_unichar(*ch);
+			}
+		}
+		if (attr) {
+			*attr = cell & A_ATTRIBUTES;
+		}
+	}
+#endif
+
+	return TRUE;
+}
+
+gchar *
+gnt_screen_get_text(void)
+{
+	GString *text;
+	int x, y;
+
+	g_return_val_if_fail(curscr != NULL, NULL);
+
+	text = g_string_sized_new((getmaxx(curscr) + 1) * getmaxy(curscr));
+	for (y = 0; y < getmaxy(curscr); y++) {
+		for (x = 0; x < getmaxx(curscr); x++) {
+			gunichar ch = ' ';
+			int width;
+
+			gnt_screen_get_cell(x, y, &ch, NULL);
+			g_string_append_unichar(text, ch);
+			/* The cells covered by the rest of a wide character
+			 * repeat it. */
+			width = g_unichar_iswide(ch) ? 2 : 1;
+			x += width - 1;
+		}
+		g_string_append_c(text, '\n');
+	}
+
+	return g_string_free(text, FALSE);
+}
+
 static gboolean
 refresh_screen(void)
 {
@@ -605,6 +846,7 @@ init_wm(void)
 	}
 	if (wm == NULL)
 		wm = g_object_new(GNT_TYPE_WM, NULL);
+	gnt_wm_set_default(wm);
 }
 
 void gnt_init()
@@ -612,13 +854,14 @@ void gnt_init()
 	char *filename;
 	const char *locale;
 #ifndef _WIN32
+	const char *headless;
 	struct sigaction act;
 #ifdef SIGWINCH
 	struct sigaction oact;
 #endif
 #endif
 
-	if (channel)
+	if (channel || headless_screen)
 		return;
 
 #ifdef _WIN32
@@ -629,7 +872,11 @@ void gnt_init()
 
 	locale = setlocale(LC_ALL, "");
 
-	setup_io();
+#ifndef _WIN32
+	headless = g_getenv("GNT_HEADLESS");
+	if (headless == NULL || *headless == '\0')
+#endif
+		setup_io();
 
 #if !NCURSES_WIDECHAR
 	ascii_only = TRUE;
@@ -643,7 +890,12 @@ void gnt_init()
 	}
 #endif
 
-	initscr();
+#ifndef _WIN32
+	if (headless && *headless)
+		headless_setup(headless);
+	else
+#endif
+		initscr();
 	typeahead(-1);
 	noecho();
 
@@ -678,14 +930,17 @@ void gnt_init()
 #ifdef SIGWINCH
 	org_winch_handler = NULL;
 	org_winch_handler_sa = NULL;
-	sigaction(SIGWINCH, &act, &oact);
-	if (oact.sa_flags & SA_SIGINFO)
-	{
-		org_winch_handler_sa = oact.sa_sigaction;
-	}
-	else if (oact.sa_handler != SIG_DFL && oact.sa_handler != SIG_IGN)
-	{
-		org_winch_handler = oact.sa_handler;
+	/* The size of a headless screen does not follow the terminal. */
+	if (headless_screen == NULL) {
+		sigaction(SIGWINCH, &act, &oact);
+		if (oact.sa_flags & SA_SIGINFO)
+		{
+			org_winch_handler_sa = oact.sa_sigaction;
+		}
+		else if (oact.sa_handler != SIG_DFL && oact.sa_handler != SIG_IGN)
+		{
+			org_winch_handler = oact.sa_handler;
+		}
 	}
 #endif
 	sigaction(SIGCHLD, &act, NULL);
@@ -703,6 +958,11 @@ void gnt_main()
 {
 	GMainLoop *loop = g_main_loop_new(NULL, FALSE);
 	gnt_wm_set_mainloop(wm, loop);
+#ifndef _WIN32
+	/* The script quits the loop, so it only starts along with it. */
+	if (headless_screen && headless_script.lines == NULL)
+		headless_read_script(g_getenv("GNT_HEADLESS_INPUT"));
+#endif
 	g_main_loop_run(loop);
 }
 
@@ -786,6 +1046,21 @@ void gnt_quit()
 	channel_error_callback = 0;
 	channel_read_callback = 0;
 
+	if (headless_script.source) {
+		g_source_remove(headless_script.source);
+		headless_script.source = 0;
+	}
+	g_clear_pointer(&headless_script.lines, g_strfreev);
+
+#ifndef _WIN32
+	if (headless_screen) {
+		const char *dump = g_getenv("GNT_HEADLESS_DUMP");
+		if (dump && *dump)
+			headless_dump_screen(dump);
+	}
+#endif
+
+	gnt_wm_set_default(NULL);
 	g_object_unref(G_OBJECT(wm));
 	wm = NULL;
 
@@ -795,6 +1070,14 @@ void gnt_quit()
 	gnt_uninit_styles();
 	endwin();
 
+	if (headless_screen) {
+		delscreen(headless_screen);
+		headless_screen = NULL;
+		fclose(headless_out);
+		fclose(headless_in);
+		headless_out = headless_in = NULL;
+	}
+
 	g_clear_pointer(&custom_config_dir, g_free);
 }
 
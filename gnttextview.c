@@ -34,143 +34,1594 @@
 #include <string.h>
 #include <unistd.h>
 
+/* A ring buffer of GntTextLine, so the oldest lines can be dropped cheaply */
+typedef struct
+{
+	struct _GntTextLine **data;
+	guint first;  /* Position of the oldest line in data */
+	guint count;
+	guint size;   /* Always a power of two */
+} GntTextLineRing;
+
+/* The text of the lines is stored in chunks, which are only ever appended to,
+ * so the text never moves once it is stored. A chunk is freed once none of
+ * its text is used anymore. */
+typedef struct
+{
+	gsize size;
+	gsize used;
+	gsize live;  /* Bytes of the chunk that are still used by some line */
+	char *data;
+} GntTextChunk;
+
+/* A position in the text. Lines are numbered from the first line ever added
+ * to the view, so positions stay valid when old lines are dropped. */
+typedef struct
+{
+	guint64 line;
+	guint offset;  /* Byte offset in the line */
+} GntTextPos;
+
+/* A search through the text. It runs a slice at a time in an idle callback,
+ * so searching a long scrollback doesn't hold up the main loop. */
+typedef struct
+{
+	GntTextSearchFlags flags;
+	GRegex *regex;     /* NULL when the pattern is searched for as plain text */
+	GRegex *raw_regex; /* The same, for lines that are not valid UTF-8 */
+	char *needle;      /* The plain text pattern */
+	gsize needle_len;
+	GntTextPos pos;    /* Where the search goes on. A backward search looks
+	                      for matches starting before it. */
+	GntTextPos match_start;
+	GntTextPos match_end;
+	gboolean matched;
+	guint idle;
+} GntTextSearch;
+
+/* Size of the buffer for reading from a stream */
+#define STREAM_BUFFER 65536
+
+/* A stream the text of the view is read from */
+typedef struct
+{
+	GIOChannel *channel;
+	guint watch;       /* 0 while reading is paused */
+	GntTextStreamFlags flags;
+	GntTextFormatFlags format;  /* As set by the escape sequences so far */
+	chtype attr;       /* What they set that there is no format flag for */
+	gboolean cr;       /* The last line ended with a \r, so a \n is part of it */
+	gsize pending;     /* Bytes left in the buffer from the last read */
+	char buffer[STREAM_BUFFER + 1];  /* With room for a nul at the end */
+} GntTextStream;
+
+/* What a row of the view showed when it was last drawn */
+typedef struct
+{
+	guint64 line;  /* The number of the line, or G_MAXUINT64 for nothing */
+	guint start;   /* The part of the line in the row */
+	guint end;
+} GntTextDrawnRow;
+
+/* What else the view was last drawn with. When any of it changes, every row
+ * is drawn again. */
+typedef struct
+{
+	int width;
+	int height;
+	GntTextViewFlag flags;
+	gboolean selected;
+	GntTextPos select_start;
+	GntTextPos select_end;
+	gboolean matched;
+	GntTextPos match_start;
+	GntTextPos match_end;
+} GntTextDrawState;
+
+/* The scrollbar, as last drawn */
+typedef struct
+{
+	int position;
+	int showing;  /* The length of the thumb, 0 when there is none */
+	gboolean up;
+	gboolean down;
+} GntTextScrollbar;
+
 struct _GntTextView
 {
-	GntWidget parent;
+	GntWidget parent;
+
+	GntTextChunk *chunk;   /* The chunk new text is added to */
+	gsize live_bytes;      /* Bytes of text in the lines */
+	gsize dead_bytes;      /* Bytes in the chunks that no line uses anymore */
+	GString *text;         /* The whole text, for gnt_text_view_get_text */
+	GntTextLineRing lines; /* The lines, oldest first */
+	guint64 first_line;    /* The number of the oldest line */
+
+	/* The view is anchored to its bottom-most visible row */
+	guint bottom;      /* Index of the line of the bottom-most visible row */
+	guint bottom_row;  /* The row in that line */
+	guint bottom_abs;  /* Number of rows before the bottom-most visible row */
+	guint total_rows;  /* Number of rows in all the lines */
+
+	int reflow_next;   /* Lines from here back are rewrapped in the background */
+	guint reflow_idle;
+
+	guint max_lines; /* Scrollback limits, 0 means unlimited */
+	gsize max_bytes;
+
+	guint draw_timeout;  /* Pending coalesced redraw */
+	guint batch;         /* Nesting level of gnt_text_view_begin_batch */
+	gboolean needs_draw; /* The text changed since the view was last drawn */
+
+	/* What is on screen, so that appending text only draws the rows that
+	 * change. drawn is NULL until the view is drawn in full. */
+	GntTextDrawnRow *drawn;
+	GntTextDrawState drawn_state;
+	GntTextScrollbar drawn_scrollbar;
+	guint64 changed_from; /* The first line changed since the last draw */
+
+	GntTextPos select_start;
+	GntTextPos select_end;
+	gboolean selecting;  /* The mouse was pressed over some text */
+	gboolean selected;   /* select_start to select_end is selected */
+
+	GHashTable *tag_index; /* Tag name -> GQueue of its GntTextTags */
+	GQueue tags;           /* All the tags, in the order of the text */
+	GntTextSearch *search;
+	GntTextStream *stream;
+	GntTextViewFlag flags;
+};
+
+typedef struct
+{
+	guint32 start; /* Offsets from the start of the line */
+	guint32 end;   /* This is the next byte of the last character of this segment */
+	chtype flags;
+} GntTextSegment;
+
+typedef struct
+{
+	guint32 start;  /* Offsets from the start of the line */
+	guint32 end;
+} GntTextRow;
+
+/* The width of the text before the first character that starts at or after
+ * a multiple of TEXT_COLS_STEP bytes. */
+typedef struct
+{
+	guint32 offset;  /* Where that character starts */
+	guint32 col;
+} GntTextCols;
+
+/* A line of text, as separated by newlines. It is wrapped into one or more
+ * rows to fit in the view. */
+typedef struct _GntTextLine
+{
+	GntTextChunk *chunk;
+	char *text;       /* The text of the line is contiguous, in the chunk */
+	guint len;
+
+	/* Onscreen width of the text before every TEXT_COLS_STEP bytes of the
+	 * line, as GntTextCols. This is NULL as long as the line is plain ASCII,
+	 * where width and offset agree. */
+	GArray *cols;
+
+	/* The wrapped rows. This is NULL when the line fits in a single row. */
+	GArray *rows;
+	int wrap_width;   /* The width the rows were wrapped for */
+	gboolean wrap_char;
+
+	/* The formatted parts of the text, in order. They are allocated along with
+	 * the line, with room for a power of two of them. */
+	guint n_segments;
+	GntTextSegment segments[];
+} GntTextLine;
+
+typedef struct
+{
+	const char *name;  /* Owned by the tag index */
+	GntTextPos start;
+	GntTextPos end;
+	GList *link;       /* The link in the list of all the tags */
+} GntTextTag;
+
+#define LINE_RING_SLOT(ring, index) \
+	((ring)->data[((ring)->first + (index)) & ((ring)->size - 1)])
+
+#define TEXT_LINE(view, index) LINE_RING_SLOT(&(view)->lines, index)
+
+/* Bytes of a line between the widths kept for it, which are worked out from
+ * the text in between when needed */
+#define TEXT_COLS_STEP 128
+
+/* Size of the first chunk of text of a view. Each chunk after it is twice as
+ * big as the one before, up to TEXT_CHUNK_SIZE, unless a line needs more. */
+#define TEXT_CHUNK_MIN 256
+#define TEXT_CHUNK_SIZE 65536
+
+/* Don't bother compacting the text for less than this many unused bytes */
+#define SCROLLBACK_COMPACT_MIN 4096
+
+/* Number of lines rewrapped in one go when reflowing in the background */
+#define REFLOW_CHUNK 1000
+
+/* Time a search may take in one go, in microseconds */
+#define SEARCH_SLICE 5000
+
+/* Number of reads from a stream in one go, so a fast writer doesn't hold up
+ * the main loop */
+#define STREAM_READS 4
+
+/* Escape sequences longer than this are not looked at */
+#define STREAM_ESCAPE_MAX 64
+
+enum
+{
+	SIG_SEARCH_DONE,
+	SIG_STREAM_END,
+	SIGS
+};
+
+static guint signals[SIGS] = { 0 };
+
+static gboolean double_click;
+static char no_text[1];  /* The text of empty lines */
+
+static guint default_max_lines;
+static gsize default_max_bytes;
+
+static void reset_text_view(GntTextView *view);
+static void free_text_line(GntTextView *view, GntTextLine *line);
+static void text_view_stream_watch(GntTextView *view);
+static void text_view_stream_free(GntTextView *view);
+
+G_DEFINE_TYPE(GntTextView, gnt_text_view, GNT_TYPE_WIDGET)
+
+static int
+text_pos_compare(const GntTextPos *a, const GntTextPos *b)
+{
+	if (a->line != b->line)
+		return a->line < b->line ? -1 : 1;
+	return (int)a->offset - (int)b->offset;
+}
+
+/******************************************************************************
+ * Line ring buffer
+ *****************************************************************************/
+static void
+line_ring_init(GntTextLineRing *ring)
+{
+	ring->size = 16;
+	ring->data = g_new0(GntTextLine *, ring->size);
+	ring->first = 0;
+	ring->count = 0;
+}
+
+static void
+line_ring_free(GntTextLineRing *ring)
+{
+	g_free(ring->data);
+	ring->data = NULL;
+	ring->count = 0;
+}
+
+static void
+line_ring_push(GntTextLineRing *ring, GntTextLine *line)
+{
+	if (ring->count == ring->size) {
+		GntTextLine **data = g_new0(GntTextLine *, ring->size * 2);
+		guint head = ring->size - ring->first;
+
+		/* Unroll the ring while growing it */
+		memcpy(data, ring->data + ring->first, head * sizeof(*data));
+		memcpy(data + head, ring->data, ring->first * sizeof(*data));
+		g_free(ring->data);
+		ring->data = data;
+		ring->first = 0;
+		ring->size *= 2;
+	}
+	LINE_RING_SLOT(ring, ring->count) = line;
+	ring->count++;
+}
+
+static GntTextLine *
+line_ring_pop(GntTextLineRing *ring)
+{
+	GntTextLine *line = ring->data[ring->first];
+
+	ring->first = (ring->first + 1) & (ring->size - 1);
+	ring->count--;
+	return line;
+}
+
+static void
+line_ring_insert(GntTextLineRing *ring, guint index, GntTextLine *line)
+{
+	guint i;
+
+	line_ring_push(ring, line);
+	for (i = ring->count - 1; i > index; i--)
+		LINE_RING_SLOT(ring, i) = LINE_RING_SLOT(ring, i - 1);
+	LINE_RING_SLOT(ring, index) = line;
+}
+
+static GntTextLine *
+line_ring_remove(GntTextLineRing *ring, guint index)
+{
+	GntTextLine *line = LINE_RING_SLOT(ring, index);
+
+	for (; index + 1 < ring->count; index++)
+		LINE_RING_SLOT(ring, index) = LINE_RING_SLOT(ring, index + 1);
+	ring->count--;
+	return line;
+}
+
+/* Forget the copy of the text made by gnt_text_view_get_text. It is made again
+ * the next time it is asked for, rather than kept up to date with every
+ * change, which would double the memory the text takes. */
+static void
+text_view_drop_text(GntTextView *view)
+{
+	if (view->text) {
+		g_string_free(view->text, TRUE);
+		view->text = NULL;
+	}
+}
+
+/******************************************************************************
+ * Line layout
+ *****************************************************************************/
+/* The onscreen width of the character at text. */
+static inline guint
+text_char_width(const char *text)
+{
+	return (*text & 0x80) && g_unichar_iswide(g_utf8_get_char(text)) ? 2 : 1;
+}
+
+/* The onscreen width of the text of the line before offset. An offset in the
+ * middle of a character counts all of it but its last column. */
+static guint
+text_line_col(GntTextLine *line, guint offset)
+{
+	const char *text = line->text;
+	GntTextCols *cols;
+	guint index, pos, col;
+
+	if (line->cols == NULL)
+		return offset;
+
+	index = MIN(offset / TEXT_COLS_STEP, line->cols->len - 1);
+	cols = &g_array_index(line->cols, GntTextCols, 0);
+	while (cols[index].offset > offset)
+		index--;
+
+	pos = cols[index].offset;
+	col = cols[index].col;
+	while (pos < offset) {
+		guint next = g_utf8_next_char(text + pos) - text;
+		guint width = text_char_width(text + pos);
+
+		if (next > offset)
+			return offset < line->len ? col + width - 1 : col + width;
+		pos = next;
+		col += width;
+	}
+	return col;
+}
+
+static inline guint
+text_line_rows(GntTextLine *line)
+{
+	return line->rows ? line->rows->len : 1;
+}
+
+static inline guint
+text_line_row_start(GntTextLine *line, guint row)
+{
+	return line->rows ? g_array_index(line->rows, GntTextRow, row).start : 0;
+}
+
+static inline guint
+text_line_row_end(GntTextLine *line, guint row)
+{
+	return line->rows ? g_array_index(line->rows, GntTextRow, row).end
+	                  : line->len;
+}
+
+/* The row of the line that contains the text at offset. */
+static guint
+text_line_row_at(GntTextLine *line, guint offset)
+{
+	guint lo = 0, hi = text_line_rows(line) - 1;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo + 1) / 2;
+		if (text_line_row_start(line, mid) <= offset)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+/* Record the onscreen widths of the bytes from..to of the line. Only one width
+ * is kept for every TEXT_COLS_STEP bytes, so this costs a small fraction of the
+ * text even when it is not plain ASCII. */
+static void
+text_line_add_widths(GntTextLine *line, const char *text, guint from, guint to)
+{
+	GntTextCols cols;
+	guint i;
+
+	if (line->cols == NULL) {
+		for (i = from; i < to && !(text[i] & 0x80); i++)
+			;
+		if (i == to)
+			return;
+
+		/* Everything before from is plain ASCII */
+		line->cols = g_array_sized_new(FALSE, FALSE, sizeof(GntTextCols),
+		                               to / TEXT_COLS_STEP + 1);
+		for (i = 0; i <= from / TEXT_COLS_STEP; i++) {
+			cols.offset = cols.col = i * TEXT_COLS_STEP;
+			g_array_append_val(line->cols, cols);
+		}
+	}
+
+	/* Carry on from the last width kept, as the character it was kept for may
+	 * not have been complete. */
+	cols = g_array_index(line->cols, GntTextCols, line->cols->len - 1);
+	while (cols.offset < to) {
+		guint next = g_utf8_next_char(text + cols.offset) - text;
+
+		if (next > to)
+			break;
+		cols.col += text_char_width(text + cols.offset);
+		cols.offset = next;
+		if (next >= line->cols->len * TEXT_COLS_STEP)
+			g_array_append_val(line->cols, cols);
+	}
+}
+
+/* Wrap the text of the line into rows of the given width, starting at the
+ * given row. The earlier rows are not affected by text added to the line. */
+static void
+text_line_wrap(GntTextLine *line, const char *text, guint from_row, int width,
+               gboolean wrap_char)
+{
+	guint len = line->len;
+	guint start = text_line_row_start(line, from_row);
+	GntTextRow row;
+
+	if (line->rows)
+		g_array_set_size(line->rows, from_row);
+	line->wrap_width = width;
+	line->wrap_char = wrap_char;
+
+	while (width > 0 &&
+	       text_line_col(line, len) - text_line_col(line, start) > (guint)width) {
+		guint base = text_line_col(line, start);
+		guint lo = start, hi = len;
+		guint end, next;
+
+		/* Find the last offset that still fits in the row */
+		while (lo < hi) {
+			guint mid = lo + (hi - lo + 1) / 2;
+			if (text_line_col(line, mid) - base <= (guint)width)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		end = lo;
+		while (end > start && (text[end] & 0xc0) == 0x80)
+			end--;
+		if (end == start) {
+			/* Not even a single character fits, so show it anyway */
+			end = g_utf8_next_char(text + start) - text;
+		}
+
+		next = end;
+		if (!wrap_char) {
+			if (g_ascii_isspace(text[end])) {
+				/* Drop the space at the wrap */
+				next = end + 1;
+			} else {
+				guint space = end;
+				while (space > start && !g_ascii_isspace(text[space - 1]))
+					space--;
+				if (space > start)
+					end = next = space;
+			}
+		}
+
+		if (line->rows == NULL)
+			line->rows = g_array_new(FALSE, FALSE, sizeof(GntTextRow));
+		row.start = start;
+		row.end = end;
+		g_array_append_val(line->rows, row);
+		start = next;
+	}
+
+	if (line->rows && line->rows->len == 0) {
+		g_array_free(line->rows, TRUE);
+		line->rows = NULL;
+	} else if (line->rows && start < len) {
+		row.start = start;
+		row.end = len;
+		g_array_append_val(line->rows, row);
+	}
+}
+
+static int
+text_view_wrap_width(GntTextView *view)
+{
+	gint width;
+
+	gnt_widget_get_internal_size(GNT_WIDGET(view), &width, NULL);
+	return width - !(view->flags & GNT_TEXT_VIEW_NO_SCROLL);
+}
+
+/* The lines from the one at index on show something else than when the view
+ * was last drawn. */
+static inline void
+text_view_mark_changed(GntTextView *view, guint index)
+{
+	view->changed_from = MIN(view->changed_from, view->first_line + index);
+}
+
+/* Rewrap a line, starting at the given row, and keep the row counts of the
+ * view up to date. */
+static void
+text_view_wrap_line(GntTextView *view, guint index, guint from_row)
+{
+	GntTextLine *line = TEXT_LINE(view, index);
+	guint old_rows = text_line_rows(line);
+	guint anchor = 0;
+	guint rows;
+
+	if (index == view->bottom)
+		anchor = text_line_row_start(line, view->bottom_row);
+
+	text_line_wrap(line, line->text, from_row,
+	               text_view_wrap_width(view),
+	               (view->flags & GNT_TEXT_VIEW_WRAP_CHAR) != 0);
+
+	rows = text_line_rows(line);
+	view->total_rows = view->total_rows - old_rows + rows;
+	if (index < view->bottom) {
+		view->bottom_abs = view->bottom_abs - old_rows + rows;
+	} else if (index == view->bottom) {
+		/* Keep the same text at the bottom of the view */
+		guint row = text_line_row_at(line, anchor);
+		view->bottom_abs = view->bottom_abs - view->bottom_row + row;
+		view->bottom_row = row;
+	}
+}
+
+/* Make sure the line is wrapped for the current size of the view. */
+static void
+text_view_update_line(GntTextView *view, guint index)
+{
+	GntTextLine *line = TEXT_LINE(view, index);
+
+	if (line->wrap_width != text_view_wrap_width(view) ||
+	    line->wrap_char != ((view->flags & GNT_TEXT_VIEW_WRAP_CHAR) != 0))
+		text_view_wrap_line(view, index, 0);
+}
+
+/* The text of the line was changed, so update its widths and rows. */
+static void
+text_view_line_changed(GntTextView *view, guint index)
+{
+	GntTextLine *line = TEXT_LINE(view, index);
+
+	if (line->cols) {
+		g_array_free(line->cols, TRUE);
+		line->cols = NULL;
+	}
+	text_line_add_widths(line, line->text, 0, line->len);
+	text_view_wrap_line(view, index, 0);
+	text_view_mark_changed(view, index);
+}
+
+/* Move the bottom of the view by the given number of rows. */
+static void
+text_view_move_bottom(GntTextView *view, int rows)
+{
+	GntTextLine *line;
+
+	text_view_update_line(view, view->bottom);
+	while (rows > 0) {
+		guint left;
+
+		line = TEXT_LINE(view, view->bottom);
+		left = text_line_rows(line) - 1 - view->bottom_row;
+		if ((guint)rows <= left) {
+			view->bottom_row += rows;
+			view->bottom_abs += rows;
+			break;
+		}
+		if (view->bottom + 1 >= view->lines.count) {
+			view->bottom_row += left;
+			view->bottom_abs += left;
+			break;
+		}
+		rows -= left + 1;
+		view->bottom_abs += left + 1;
+		view->bottom++;
+		view->bottom_row = 0;
+		text_view_update_line(view, view->bottom);
+	}
+
+	while (rows < 0) {
+		if ((guint)-rows <= view->bottom_row) {
+			view->bottom_row += rows;
+			view->bottom_abs += rows;
+			break;
+		}
+		if (view->bottom == 0) {
+			view->bottom_abs -= view->bottom_row;
+			view->bottom_row = 0;
+			break;
+		}
+		text_view_update_line(view, view->bottom - 1);
+		rows += view->bottom_row + 1;
+		view->bottom_abs -= view->bottom_row + 1;
+		view->bottom--;
+		view->bottom_row = text_line_rows(TEXT_LINE(view, view->bottom)) - 1;
+	}
+}
+
+/* Move to the row above, if there is one. */
+static gboolean
+text_view_row_above(GntTextView *view, int *index, guint *row)
+{
+	if (*row > 0) {
+		(*row)--;
+		return TRUE;
+	}
+	if (*index == 0) {
+		*index = -1;
+		return FALSE;
+	}
+	(*index)--;
+	text_view_update_line(view, *index);
+	*row = text_line_rows(TEXT_LINE(view, *index)) - 1;
+	return TRUE;
+}
+
+#define TEXT_LINE_SIZE(n_segments) \
+	(G_STRUCT_OFFSET(GntTextLine, segments) + (n_segments) * sizeof(GntTextSegment))
+
+static inline guint
+text_line_capacity(guint n_segments)
+{
+	guint capacity = 1;
+
+	while (capacity < n_segments)
+		capacity <<= 1;
+	return capacity;
+}
+
+static GntTextLine *
+text_view_new_line(GntTextView *view)
+{
+	GntTextLine *line = g_malloc0(TEXT_LINE_SIZE(1));
+
+	line->text = no_text;
+	line->wrap_width = text_view_wrap_width(view);
+	line->wrap_char = (view->flags & GNT_TEXT_VIEW_WRAP_CHAR) != 0;
+	return line;
+}
+
+/* Start a new line at the end of the text. */
+static void
+text_view_add_line(GntTextView *view)
+{
+	line_ring_push(&view->lines, text_view_new_line(view));
+	view->total_rows++;
+}
+
+/* Insert an empty line before the line at index. */
+static void
+text_view_insert_line(GntTextView *view, guint index)
+{
+	line_ring_insert(&view->lines, index, text_view_new_line(view));
+	view->total_rows++;
+	text_view_mark_changed(view, index);
+	if (index <= view->bottom) {
+		view->bottom++;
+		view->bottom_abs++;
+	}
+	if ((int)index <= view->reflow_next)
+		view->reflow_next++;
+}
+
+static void
+text_view_remove_line(GntTextView *view, guint index)
+{
+	GntTextLine *line = line_ring_remove(&view->lines, index);
+	guint rows = text_line_rows(line);
+
+	text_view_mark_changed(view, index);
+
+	if ((int)index <= view->reflow_next)
+		view->reflow_next--;
+	view->total_rows -= rows;
+	if (index < view->bottom) {
+		view->bottom--;
+		view->bottom_abs -= rows;
+	} else if (index == view->bottom) {
+		view->bottom_abs -= view->bottom_row;
+		view->bottom_row = 0;
+		if (index > 0) {
+			view->bottom--;
+			view->bottom_row = text_line_rows(TEXT_LINE(view, view->bottom)) - 1;
+			view->bottom_abs--;
+		}
+	}
+	free_text_line(view, line);
+}
+
+static gboolean
+text_view_reflow_idle(gpointer data)
+{
+	GntTextView *view = GNT_TEXT_VIEW(data);
+	int count;
+
+	view->reflow_next = MIN(view->reflow_next, (int)view->lines.count - 1);
+	for (count = 0; count < REFLOW_CHUNK && view->reflow_next >= 0; count++) {
+		text_view_update_line(view, view->reflow_next--);
+	}
+	if (view->reflow_next >= 0)
+		return TRUE;
+
+	view->reflow_idle = 0;
+	/* The scrollbar needs to catch up */
+	if (gnt_widget_get_window(GNT_WIDGET(view))) {
+		gnt_widget_draw(GNT_WIDGET(view));
+	}
+	return FALSE;
+}
+
+/******************************************************************************
+ * Line text
+ *****************************************************************************/
+static GntTextChunk *
+text_chunk_new(gsize size)
+{
+	GntTextChunk *chunk = g_new0(GntTextChunk, 1);
+
+	chunk->size = size;
+	chunk->data = g_malloc(size);
+	return chunk;
+}
+
+static void
+text_chunk_free(GntTextChunk *chunk)
+{
+	g_free(chunk->data);
+	g_free(chunk);
+}
+
+/* Find room for len bytes of text in the current chunk, or in a new one if it
+ * is full. */
+static char *
+text_view_reserve(GntTextView *view, gsize len, GntTextChunk **chunk)
+{
+	GntTextChunk *current = view->chunk;
+	gsize size = TEXT_CHUNK_MIN;
+	char *text;
+
+	if (current == NULL || current->size - current->used < len) {
+		if (current) {
+			size = MIN(current->size * 2, TEXT_CHUNK_SIZE);
+			/* The rest of the old chunk is left unused */
+			view->dead_bytes += current->size - current->used;
+			current->used = current->size;
+			if (current->live == 0) {
+				view->dead_bytes -= current->used;
+				text_chunk_free(current);
+			}
+		}
+		/* Leave room for long lines to grow */
+		current = view->chunk = text_chunk_new(MAX(size, len * 2));
+	}
+
+	text = current->data + current->used;
+	current->used += len;
+	current->live += len;
+	view->live_bytes += len;
+	*chunk = current;
+	return text;
+}
+
+/* The len bytes of text of a line in the chunk are not used anymore. */
+static void
+text_view_release(GntTextView *view, GntTextChunk *chunk, const char *text,
+                  gsize len)
+{
+	if (chunk == NULL || len == 0)
+		return;
+
+	chunk->live -= len;
+	view->live_bytes -= len;
+	if (chunk == view->chunk && text + len == chunk->data + chunk->used) {
+		/* This was the last text added, so it can just be taken back */
+		chunk->used -= len;
+		return;
+	}
+
+	view->dead_bytes += len;
+	if (chunk->live == 0 && chunk != view->chunk) {
+		view->dead_bytes -= chunk->used;
+		text_chunk_free(chunk);
+	}
+}
+
+/* Move the text of the line to the current chunk, with room for extra more
+ * bytes at the end. */
+static void
+text_view_line_move(GntTextView *view, GntTextLine *line, gsize extra)
+{
+	GntTextChunk *chunk;
+	char *text = text_view_reserve(view, line->len + extra, &chunk);
+
+	memcpy(text, line->text, line->len);
+	text_view_release(view, line->chunk, line->text, line->len);
+	/* Only keep what is used for now */
+	chunk->used -= extra;
+	chunk->live -= extra;
+	view->live_bytes -= extra;
+	line->chunk = chunk;
+	line->text = text;
+}
+
+/* Add some text to the end of a line. */
+static void
+text_view_line_append(GntTextView *view, guint index, const char *text,
+                      gsize len, chtype fl)
+{
+	GntTextLine *line = TEXT_LINE(view, index);
+	GntTextChunk *chunk = line->chunk;
+	GntTextSegment *seg;
+
+	text_view_mark_changed(view, index);
+	if (chunk && line->text + line->len == chunk->data + chunk->used &&
+	    chunk->size - chunk->used >= len) {
+		/* The line is the last thing in its chunk, so it can grow in place */
+	} else {
+		text_view_line_move(view, line, len);
+		chunk = line->chunk;
+	}
+	memcpy(line->text + line->len, text, len);
+	chunk->used += len;
+	chunk->live += len;
+	view->live_bytes += len;
+
+	/* Try to append to the previous segment if possible */
+	if (line->n_segments > 0 &&
+	    line->segments[line->n_segments - 1].flags == fl) {
+		seg = &line->segments[line->n_segments - 1];
+	} else {
+		if (line->n_segments == text_line_capacity(line->n_segments)) {
+			line = g_realloc(line, TEXT_LINE_SIZE(
+			        text_line_capacity(line->n_segments + 1)));
+			TEXT_LINE(view, index) = line;
+		}
+		seg = &line->segments[line->n_segments++];
+		seg->start = line->len;
+		seg->flags = fl;
+	}
+	line->len += len;
+	seg->end = line->len;
+}
+
+/* Cut the line down to its first len bytes. */
+static void
+text_view_line_truncate(GntTextView *view, GntTextLine *line, guint len)
+{
+	text_view_release(view, line->chunk, line->text + len, line->len - len);
+	line->len = len;
+	if (len == 0) {
+		line->chunk = NULL;
+		line->text = no_text;
+	}
+
+	while (line->n_segments > 0 &&
+	       line->segments[line->n_segments - 1].start >= len)
+		line->n_segments--;
+	if (line->n_segments > 0)
+		line->segments[line->n_segments - 1].end = len;
+}
+
+/* The format the text replacing from..to should take. */
+static chtype
+text_view_splice_format(GntTextView *view, const GntTextPos *from,
+                        const GntTextPos *to)
+{
+	guint first = from->line - view->first_line;
+	guint last = to->line - view->first_line;
+	chtype prev = gnt_text_format_flag_to_chtype(GNT_TEXT_FLAG_NORMAL);
+	guint index, i;
+
+	/* The first segment with some of the replaced text */
+	for (index = first; index <= last; index++) {
+		GntTextLine *line = TEXT_LINE(view, index);
+
+		for (i = 0; i < line->n_segments; i++) {
+			GntTextSegment *seg = &line->segments[i];
+
+			if (index == last && seg->start >= to->offset)
+				break;
+			if (index > first || seg->end > from->offset)
+				return seg->flags;
+			prev = seg->flags;
+		}
+	}
+
+	/* Otherwise, whatever comes right before */
+	return prev;
+}
+
+/* Replace the text from..to with some new text, which may contain newlines.
+ * Only the lines involved are changed, and the text of the other lines stays
+ * where it is. Returns the position after the new text. */
+static GntTextPos
+text_view_splice(GntTextView *view, const GntTextPos *from,
+                 const GntTextPos *to, const char *text)
+{
+	guint index = from->line - view->first_line;
+	guint last = to->line - view->first_line;
+	guint current = index;
+	GntTextLine *line = TEXT_LINE(view, last);
+	chtype fl = text_view_splice_format(view, from, to);
+	GntTextSegment *tail;
+	guint n_tail = 0;
+	char *tail_text;
+	GntTextPos end;
+	guint i;
+
+	/* Keep the text after the replaced text */
+	tail_text = g_strndup(line->text + to->offset,
+	                      line->len - to->offset);
+	tail = g_new(GntTextSegment, line->n_segments);
+	for (i = 0; i < line->n_segments; i++) {
+		GntTextSegment *seg = &line->segments[i];
+
+		if (seg->end > to->offset) {
+			tail[n_tail].start = MAX(seg->start, to->offset) - to->offset;
+			tail[n_tail].end = seg->end - to->offset;
+			tail[n_tail].flags = seg->flags;
+			n_tail++;
+		}
+	}
+
+	text_view_line_truncate(view, TEXT_LINE(view, index), from->offset);
+	for (i = index + 1; i <= last; i++)
+		text_view_line_truncate(view, TEXT_LINE(view, i), 0);
+
+	/* Put the new text in the emptied lines, and add more lines if needed */
+	while (text && *text) {
+		gsize len;
+
+		if (*text == '\n' || *text == '\r') {
+			if (!strncmp(text, "\r\n", 2))
+				text++;
+			text++;
+			current++;
+			if (current > last) {
+				text_view_insert_line(view, current);
+				last = current;
+			}
+			continue;
+		}
+
+		len = strcspn(text, "\r\n");
+		text_view_line_append(view, current, text, len, fl);
+		text += len;
+	}
+
+	/* Drop the lines that are left over */
+	for (; last > current; last--)
+		text_view_remove_line(view, last);
+
+	end.line = view->first_line + current;
+	end.offset = TEXT_LINE(view, current)->len;
+	for (i = 0; i < n_tail; i++) {
+		text_view_line_append(view, current, tail_text + tail[i].start,
+		                      tail[i].end - tail[i].start, tail[i].flags);
+	}
+	g_free(tail);
+	g_free(tail_text);
+
+	for (i = index; i <= current; i++)
+		text_view_line_changed(view, i);
+
+	return end;
+}
+
+/* Update a position for a splice that replaced from..to with text that now
+ * ends at new_to. */
+static void
+text_pos_splice(GntTextPos *pos, const GntTextPos *from, const GntTextPos *to,
+                const GntTextPos *new_to)
+{
+	if (text_pos_compare(pos, from) < 0)
+		return;
+	if (text_pos_compare(pos, to) < 0) {
+		*pos = *from;
+	} else if (pos->line == to->line) {
+		pos->line = new_to->line;
+		pos->offset = pos->offset - to->offset + new_to->offset;
+	} else {
+		pos->line = pos->line - to->line + new_to->line;
+	}
+}
+
+/******************************************************************************
+ * Tags
+ *****************************************************************************/
+static void
+text_view_add_tag(GntTextView *view, const char *name, const GntTextPos *start,
+                  const GntTextPos *end)
+{
+	GntTextTag *tag = g_new0(GntTextTag, 1);
+	GQueue *queue;
+	char *key;
+
+	if (!g_hash_table_lookup_extended(view->tag_index, name,
+	                                  (gpointer *)&key, (gpointer *)&queue)) {
+		key = g_strdup(name);
+		queue = g_queue_new();
+		g_hash_table_insert(view->tag_index, key, queue);
+	}
 
-	GString *string;
-	GList *list; /* List of GntTextLine */
+	tag->name = key;
+	tag->start = *start;
+	tag->end = *end;
+	g_queue_push_tail(queue, tag);
+	g_queue_push_tail(&view->tags, tag);
+	tag->link = view->tags.tail;
+}
 
-	GList *tags; /* A list of tags */
-	GntTextViewFlag flags;
-};
+/* Remove a tag, which has to be the first one with its name. */
+static void
+text_view_remove_tag(GntTextView *view, GntTextTag *tag)
+{
+	GQueue *queue = g_hash_table_lookup(view->tag_index, tag->name);
 
-typedef struct
+	g_queue_pop_head(queue);
+	if (g_queue_is_empty(queue))
+		g_hash_table_remove(view->tag_index, tag->name);
+	g_queue_delete_link(&view->tags, tag->link);
+	g_free(tag);
+}
+
+static void
+text_view_clear_tags(GntTextView *view)
 {
-	GntTextFormatFlags tvflag;
-	chtype flags;
-	int start;
-	int end;     /* This is the next byte of the last character of this segment */
-} GntTextSegment;
+	g_hash_table_remove_all(view->tag_index);
+	while (!g_queue_is_empty(&view->tags))
+		g_free(g_queue_pop_head(&view->tags));
+}
 
-typedef struct
+/******************************************************************************
+ * Search
+ *****************************************************************************/
+/* Find the first occurrence of the plain text pattern that starts between
+ * text and last. memchr does the bulk of the work, as it is much faster than
+ * comparing the pattern at every byte. */
+static const char *
+text_search_find(GntTextSearch *search, const char *text, const char *last)
 {
-	GList *segments;         /* A list of GntTextSegments */
-	int length;              /* The current length of the line so far (ie. onscreen width) */
-	gboolean soft;           /* TRUE if it's an overflow from prev. line */
-} GntTextLine;
+	const char *needle = search->needle;
+	gsize n = search->needle_len;
+	const char *lower, *upper;
+	char lc, uc;
 
-typedef struct
+	if (text > last)
+		return NULL;
+
+	if (!(search->flags & GNT_TEXT_SEARCH_CASE_INSENSITIVE)) {
+		while ((text = memchr(text, needle[0], last - text + 1))) {
+			if (memcmp(text + 1, needle + 1, n - 1) == 0)
+				return text;
+			if (text++ == last)
+				break;
+		}
+		return NULL;
+	}
+
+	/* Only ASCII patterns get here, so the first byte has at most two cases */
+	lc = g_ascii_tolower(needle[0]);
+	uc = g_ascii_toupper(needle[0]);
+	lower = memchr(text, lc, last - text + 1);
+	upper = lc == uc ? NULL : memchr(text, uc, last - text + 1);
+	while (lower || upper) {
+		const char *p = (upper == NULL || (lower && lower < upper)) ? lower : upper;
+
+		if (g_ascii_strncasecmp(p + 1, needle + 1, n - 1) == 0)
+			return p;
+		if (p == lower)
+			lower = memchr(lower + 1, lc, last - lower);
+		else
+			upper = memchr(upper + 1, uc, last - upper);
+	}
+	return NULL;
+}
+
+/* Find the first match that starts at offset from or later. */
+static gboolean
+text_search_line_forward(GntTextSearch *search, GntTextLine *line, guint from,
+                         guint *start, guint *end)
 {
-	char *name;
-	int start;
-	int end;
-} GntTextTag;
+	const char *text = line->text;
+	GRegex *regex;
+	GMatchInfo *info;
+	gint s, e;
+	gboolean found;
 
-static gchar *select_start;
-static gchar *select_end;
-static gboolean double_click;
+	if (search->regex == NULL) {
+		const char *p;
 
-static void reset_text_view(GntTextView *view);
+		if (line->len < search->needle_len)
+			return FALSE;
+		p = text_search_find(search, text + from,
+		                     text + line->len - search->needle_len);
+		if (p == NULL)
+			return FALSE;
+		*start = p - text;
+		*end = *start + search->needle_len;
+		return TRUE;
+	}
 
-G_DEFINE_TYPE(GntTextView, gnt_text_view, GNT_TYPE_WIDGET)
+	if (from > line->len)
+		return FALSE;
+	/* GRegex can't be given invalid UTF-8, which the text may have. A line
+	 * with no column widths is plain ASCII. */
+	regex = search->regex;
+	if (line->cols && !g_utf8_validate(text, line->len, NULL))
+		regex = search->raw_regex;
+	found = g_regex_match_full(regex, text, line->len, from, 0, &info, NULL);
+	if (found) {
+		g_match_info_fetch_pos(info, 0, &s, &e);
+		*start = s;
+		*end = e;
+	}
+	g_match_info_free(info);
+	return found;
+}
 
+/* Find the last match that starts before offset to. */
 static gboolean
-text_view_contains(GntTextView *view, const char *str)
+text_search_line_backward(GntTextSearch *search, GntTextLine *line, guint to,
+                          guint *start, guint *end)
 {
-	return (str >= view->string->str && str < view->string->str + view->string->len);
+	guint s, e, from = 0;
+	gboolean found = FALSE;
+
+	while (from < to && text_search_line_forward(search, line, from, &s, &e) &&
+	       s < to) {
+		*start = s;
+		*end = e;
+		found = TRUE;
+		from = g_utf8_next_char(line->text + s) - line->text;
+	}
+	return found;
 }
 
+/* Scroll the view so that the row with the position is in the middle, unless
+ * it is visible already. */
 static void
-gnt_text_view_draw(GntWidget *widget)
+text_view_show_pos(GntTextView *view, const GntTextPos *pos)
 {
-	GntTextView *view = GNT_TEXT_VIEW(widget);
-	WINDOW *window = gnt_widget_get_window(widget);
-	gint width, height;
-	int n;
-	int i = 0;
-	GList *lines;
-	int rows, scrcol;
-	int comp = 0;          /* Used for top-aligned text */
-	gboolean has_scroll = !(view->flags & GNT_TEXT_VIEW_NO_SCROLL);
+	guint target = pos->line - view->first_line;
+	int index = view->bottom;
+	guint row = view->bottom_row;
+	guint target_row;
+	gint height, i;
 
-	gnt_widget_get_internal_size(widget, &width, &height);
+	gnt_widget_get_internal_size(GNT_WIDGET(view), NULL, &height);
+	text_view_update_line(view, view->bottom);
+	text_view_update_line(view, target);
+	target_row = text_line_row_at(TEXT_LINE(view, target), pos->offset);
+
+	for (i = 0; i < height && index >= 0; i++) {
+		if ((guint)index == target && row == target_row)
+			return;
+		text_view_row_above(view, &index, &row);
+	}
 
-	wbkgd(window, gnt_color_pair(GNT_COLOR_NORMAL));
-	werase(window);
+	while (view->bottom < target) {
+		GntTextLine *line = TEXT_LINE(view, view->bottom);
+		view->bottom_abs += text_line_rows(line) - view->bottom_row;
+		view->bottom++;
+		view->bottom_row = 0;
+		text_view_update_line(view, view->bottom);
+	}
+	while (view->bottom > target) {
+		text_view_update_line(view, view->bottom - 1);
+		view->bottom_abs -= view->bottom_row + 1;
+		view->bottom--;
+		view->bottom_row = text_line_rows(TEXT_LINE(view, view->bottom)) - 1;
+	}
+	view->bottom_abs = view->bottom_abs - view->bottom_row + target_row;
+	view->bottom_row = target_row;
+	text_view_move_bottom(view, height / 2);
+}
 
-	n = g_list_length(view->list);
-	if ((view->flags & GNT_TEXT_VIEW_TOP_ALIGN) && n < height) {
-		GList *now = view->list;
-		comp = height - n;
-		view->list = g_list_nth_prev(view->list, comp);
-		if (!view->list) {
-			view->list = g_list_first(now);
-			comp = height - g_list_length(view->list);
+static gboolean
+text_view_search_idle(gpointer data)
+{
+	GntTextView *view = GNT_TEXT_VIEW(data);
+	GntTextSearch *search = view->search;
+	gboolean backward = (search->flags & GNT_TEXT_SEARCH_BACKWARD) != 0;
+	gint64 deadline = g_get_monotonic_time() + SEARCH_SLICE;
+	gboolean found = FALSE;
+	guint count;
+
+	for (count = 1;; count++) {
+		guint index = search->pos.line - view->first_line;
+		GntTextLine *line = TEXT_LINE(view, index);
+		guint start, end;
+
+		if (backward)
+			found = text_search_line_backward(search, line, search->pos.offset,
+			                                  &start, &end);
+		else
+			found = text_search_line_forward(search, line, search->pos.offset,
+			                                 &start, &end);
+		if (found) {
+			search->match_start.line = search->pos.line;
+			search->match_start.offset = start;
+			search->match_end.line = search->pos.line;
+			search->match_end.offset = end;
+			search->matched = TRUE;
+			search->pos = backward ? search->match_start : search->match_end;
+			break;
+		}
+
+		/* Stop at the end of the text. A forward search stays there, so
+		 * searching again also finds text that was added since. */
+		if (backward) {
+			if (index == 0)
+				break;
+			search->pos.line--;
+			search->pos.offset = TEXT_LINE(view, index - 1)->len;
 		} else {
-			comp = 0;
+			search->pos.offset = line->len;
+			if (index + 1 >= view->lines.count)
+				break;
+			search->pos.line++;
+			search->pos.offset = 0;
+		}
+
+		if (count % 64 == 0 && g_get_monotonic_time() >= deadline)
+			return TRUE;
+	}
+
+	search->idle = 0;
+	if (found) {
+		text_view_show_pos(view, &search->match_start);
+		if (gnt_widget_get_window(GNT_WIDGET(view)))
+			gnt_widget_draw(GNT_WIDGET(view));
+	}
+	g_signal_emit(view, signals[SIG_SEARCH_DONE], 0, found);
+	return FALSE;
+}
+
+static void
+text_view_search_start(GntTextView *view)
+{
+	if (view->search->idle == 0)
+		view->search->idle = g_idle_add(text_view_search_idle, view);
+}
+
+static void
+text_view_search_free(GntTextView *view)
+{
+	GntTextSearch *search = view->search;
+
+	if (search == NULL)
+		return;
+	if (search->idle)
+		g_source_remove(search->idle);
+	if (search->regex)
+		g_regex_unref(search->regex);
+	if (search->raw_regex)
+		g_regex_unref(search->raw_regex);
+	g_free(search->needle);
+	g_free(search);
+	view->search = NULL;
+}
+
+/* Some lines were dropped from the top of the text. */
+static void
+text_view_search_trimmed(GntTextView *view)
+{
+	GntTextSearch *search = view->search;
+
+	if (search == NULL)
+		return;
+	if (search->matched && search->match_start.line < view->first_line)
+		search->matched = FALSE;
+	/* A backward search has nothing left to look at from there */
+	if (search->pos.line < view->first_line) {
+		search->pos.line = view->first_line;
+		search->pos.offset = 0;
+	}
+}
+
+/* The text from..to was replaced by the text up to new_to. */
+static void
+text_view_search_splice(GntTextView *view, const GntTextPos *from,
+                        const GntTextPos *to, const GntTextPos *new_to)
+{
+	GntTextSearch *search = view->search;
+
+	if (search == NULL)
+		return;
+	if (search->matched && text_pos_compare(&search->match_end, from) > 0 &&
+	    text_pos_compare(&search->match_start, to) < 0)
+		search->matched = FALSE;
+	text_pos_splice(&search->match_start, from, to, new_to);
+	text_pos_splice(&search->match_end, from, to, new_to);
+	text_pos_splice(&search->pos, from, to, new_to);
+}
+
+/******************************************************************************
+ * Scrollback
+ *****************************************************************************/
+/* Chunks are freed once all of their lines are evicted, but text that was
+ * replaced can keep a mostly unused chunk alive. Once the unused text
+ * outweighs the text in use, the lines still in such chunks are moved out,
+ * which frees the chunks. Only those lines are copied. */
+static void
+text_view_compact(GntTextView *view)
+{
+	guint i;
+
+	if (view->dead_bytes < SCROLLBACK_COMPACT_MIN ||
+	    view->dead_bytes < view->live_bytes)
+		return;
+
+	for (i = 0; i < view->lines.count; i++) {
+		GntTextLine *line = TEXT_LINE(view, i);
+		GntTextChunk *chunk = line->chunk;
+
+		if (chunk && chunk != view->chunk && chunk->live * 2 < chunk->used)
+			text_view_line_move(view, line, 0);
+	}
+}
+
+static gboolean
+text_view_over_limit(GntTextView *view)
+{
+	if (view->max_lines && view->lines.count > view->max_lines)
+		return TRUE;
+	/* Count the newlines too, as in gnt_text_view_get_text */
+	if (view->max_bytes &&
+	    view->live_bytes + view->lines.count - 1 > view->max_bytes)
+		return TRUE;
+	return FALSE;
+}
+
+/* Evict the oldest lines until the view fits in its scrollback limits. */
+static void
+text_view_trim_scrollback(GntTextView *view)
+{
+	GntTextTag *tag;
+
+	if (!text_view_over_limit(view))
+		return;
+
+	while (view->lines.count > 1 && text_view_over_limit(view)) {
+		GntTextLine *line = line_ring_pop(&view->lines);
+		guint rows = text_line_rows(line);
+
+		view->total_rows -= rows;
+		if (view->bottom > 0) {
+			view->bottom--;
+			view->bottom_abs -= rows;
+		} else {
+			view->bottom_row = 0;
+			view->bottom_abs = 0;
 		}
+		view->reflow_next--;
+		view->first_line++;
+		free_text_line(view, line);
 	}
 
-	for (i = 0, lines = view->list; i < height && lines;
-	     i++, lines = lines->next) {
-		GList *iter;
-		GntTextLine *line = lines->data;
-
-		(void)wmove(window, height - 1 - i - comp, 0);
-
-		for (iter = line->segments; iter; iter = iter->next)
-		{
-			GntTextSegment *seg = iter->data;
-			char *end = view->string->str + seg->end;
-			char back = *end;
-			chtype fl = seg->flags;
-			*end = '\0';
-			if (select_start && select_start < view->string->str + seg->start && select_end > view->string->str + seg->end) {
-				fl |= A_REVERSE;
-				wattrset(window, fl);
-				wprintw(window, "%s",
-				        C_(view->string->str + seg->start));
-			} else if (select_start && select_end &&
-				((select_start >= view->string->str + seg->start && select_start <= view->string->str + seg->end) ||
-				(select_end <= view->string->str + seg->end && select_start <= view->string->str + seg->start))) {
-				char *cur = view->string->str + seg->start;
-				while (*cur != '\0') {
-					gchar *last = g_utf8_next_char(cur);
-					gchar *str;
-					if (cur >= select_start && cur <= select_end)
-						fl |= A_REVERSE;
-					else
-						fl = seg->flags;
-					str = g_strndup(cur, last - cur);
-					wattrset(window, fl);
-					waddstr(window, C_(str));
-					g_free(str);
-					cur = g_utf8_next_char(cur);
+	/* Forget the evicted tags */
+	while ((tag = g_queue_peek_head(&view->tags)) &&
+	       tag->start.line < view->first_line)
+		text_view_remove_tag(view, tag);
+
+	if (view->select_start.line < view->first_line) {
+		view->selecting = FALSE;
+		view->selected = FALSE;
+	}
+	text_view_search_trimmed(view);
+
+	text_view_drop_text(view);
+
+	text_view_compact(view);
+}
+
+/******************************************************************************
+ * GntWidget implementation
+ *****************************************************************************/
+/* Add the text between start and end to the window. The text does not need to
+ * be nul-terminated, and nothing is allocated unless the text needs to be
+ * converted to the locale. */
+static void
+text_view_add_text(WINDOW *window, const char *start, const char *end, chtype flags)
+{
+	wattrset(window, flags);
+	if (gnt_need_conversation_to_locale) {
+		char *text = g_strndup(start, end - start);
+		waddstr(window, C_(text));
+		g_free(text);
+	} else {
+		waddnstr(window, start, end - start);
+	}
+}
+
+/* The offset after the character at pos, or after the end of the line if pos
+ * is at the end, so the newline counts as selected. */
+static guint
+text_view_select_end(GntTextView *view, const GntTextPos *pos)
+{
+	GntTextLine *line = TEXT_LINE(view, pos->line - view->first_line);
+	const char *text = line->text;
+
+	if (pos->offset >= line->len)
+		return line->len + 1;
+	return g_utf8_next_char(text + pos->offset) - text;
+}
+
+/* A part of a line that is drawn differently, like the selection */
+typedef struct
+{
+	guint from;
+	guint to;
+	chtype mask;  /* The attributes of the text that are replaced */
+	chtype attr;
+} GntTextMark;
+
+static void
+text_view_draw_row(GntTextView *view, WINDOW *window, guint index, guint row)
+{
+	GntTextLine *line = TEXT_LINE(view, index);
+	const char *text = line->text;
+	guint row_start = text_line_row_start(line, row);
+	guint row_end = text_line_row_end(line, row);
+	guint64 number = view->first_line + index;
+	GntTextSearch *search = view->search;
+	GntTextMark marks[2];
+	guint n_marks = 0;
+	guint lo = 0, hi = line->n_segments;
+
+	if (view->selected && number >= view->select_start.line &&
+	    number <= view->select_end.line) {
+		GntTextMark *mark = &marks[n_marks++];
+		mark->from = 0;
+		if (number == view->select_start.line)
+			mark->from = view->select_start.offset;
+		if (number == view->select_end.line)
+			mark->to = text_view_select_end(view, &view->select_end);
+		else
+			mark->to = line->len;
+		mark->mask = 0;
+		mark->attr = A_REVERSE;
+	}
+
+	if (search && search->matched && number == search->match_start.line) {
+		GntTextMark *mark = &marks[n_marks++];
+		mark->from = search->match_start.offset;
+		mark->to = search->match_end.offset;
+		mark->mask = A_COLOR;
+		mark->attr = gnt_color_pair(GNT_COLOR_HIGHLIGHT);
+	}
+
+	/* Find the first segment in the row */
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		if (line->segments[mid].end <= row_start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < line->n_segments; lo++)
+	{
+		GntTextSegment *seg = &line->segments[lo];
+		guint start, end;
+
+		if (seg->start >= row_end)
+			break;
+
+		/* Split the segment where the marks start and end */
+		end = MIN(seg->end, row_end);
+		for (start = MAX(seg->start, row_start); start < end;) {
+			guint next = end;
+			chtype flags = seg->flags;
+			guint i;
+
+			for (i = 0; i < n_marks; i++) {
+				if (marks[i].from <= start && start < marks[i].to) {
+					flags = (flags & ~marks[i].mask) | marks[i].attr;
+					next = MIN(next, marks[i].to);
+				} else if (marks[i].from > start) {
+					next = MIN(next, marks[i].from);
 				}
-			} else {
-				wattrset(window, fl);
-				wprintw(window, "%s",
-				        C_(view->string->str + seg->start));
 			}
-			*end = back;
+			text_view_add_text(window, text + start, text + next, flags);
+			start = next;
 		}
-		wattroff(window, A_UNDERLINE | A_BLINK | A_REVERSE);
-		whline(window, ' ', width - line->length - has_scroll);
 	}
+}
 
-	scrcol = width - 1;
-	rows = height - 2;
-	if (has_scroll && rows > 0 && lines != NULL)
+static void
+text_view_draw_state(GntTextView *view, int width, int height,
+                     GntTextDrawState *state)
+{
+	GntTextSearch *search = view->search;
+
+	memset(state, 0, sizeof(*state));
+	state->width = width;
+	state->height = height;
+	state->flags = view->flags;
+	state->selected = view->selected;
+	if (view->selected) {
+		state->select_start = view->select_start;
+		state->select_end = view->select_end;
+	}
+	state->matched = search && search->matched;
+	if (state->matched) {
+		state->match_start = search->match_start;
+		state->match_end = search->match_end;
+	}
+}
+
+static gboolean
+text_view_draw_state_equal(const GntTextDrawState *a, const GntTextDrawState *b)
+{
+	return a->width == b->width && a->height == b->height &&
+	       a->flags == b->flags && a->selected == b->selected &&
+	       text_pos_compare(&a->select_start, &b->select_start) == 0 &&
+	       text_pos_compare(&a->select_end, &b->select_end) == 0 &&
+	       a->matched == b->matched &&
+	       text_pos_compare(&a->match_start, &b->match_start) == 0 &&
+	       text_pos_compare(&a->match_end, &b->match_end) == 0;
+}
+
+/* Where the thumb of the scrollbar goes. more is whether there are rows above
+ * the view. */
+static void
+text_view_scrollbar(GntTextView *view, int height, gboolean more,
+                    GntTextScrollbar *bar)
+{
+	gboolean at_end = (view->bottom_abs + 1 >= view->total_rows);
+	int rows = height - 2;
+
+	bar->position = 0;
+	bar->showing = 0;
+	bar->up = more;
+	bar->down = !at_end;
+
+	if (rows > 0 && more)
 	{
-		int total = g_list_length(g_list_first(view->list));
+		int total = view->total_rows;
 		int showing, position, up, down;
 
 		showing = rows * rows / total + 1;
 		showing = MIN(rows, showing);
 
 		total -= rows;
-		up = g_list_length(lines);
+		up = view->bottom_abs + 1 - height;
 		down = total - up;
 
 		position = (rows - showing) * up / MAX(1, up + down);
@@ -179,28 +1630,198 @@ gnt_text_view_draw(GntWidget *widget)
 		if (showing + position > rows)
 			position = rows - showing;
 
-		if (showing + position == rows && view->list->prev)
+		if (showing + position == rows && !at_end)
 			position = MAX(1, rows - 1 - showing);
-		else if (showing + position < rows && !view->list->prev)
+		else if (showing + position < rows && at_end)
 			position = rows - showing;
 
-		mvwvline(window, position + 1, scrcol,
-		         ACS_CKBOARD | gnt_color_pair(GNT_COLOR_HIGHLIGHT_D),
-		         showing);
+		bar->position = position;
+		bar->showing = showing;
+	}
+}
+
+/* Draw the rows of the view. Unless all of it is to be drawn, only the rows
+ * that show something else than when the view was last drawn are drawn again,
+ * and only those are damaged. */
+static void
+text_view_draw(GntTextView *view, gboolean all)
+{
+	GntWidget *widget = GNT_WIDGET(view);
+	WINDOW *window = gnt_widget_get_window(widget);
+	gint width, height;
+	int n;
+	int i = 0;
+	int y;
+	int index;             /* The line being drawn */
+	guint row;             /* The row of that line */
+	int scrcol;
+	int comp = 0;          /* Used for top-aligned text */
+	gboolean has_scroll = !(view->flags & GNT_TEXT_VIEW_NO_SCROLL);
+	GntTextDrawState state;
+	GntTextScrollbar bar;
+
+	gnt_widget_get_internal_size(widget, &width, &height);
+
+	view->needs_draw = FALSE;
+	text_view_stream_watch(view);
+
+	text_view_draw_state(view, width, height, &state);
+	if (view->drawn == NULL ||
+	    !text_view_draw_state_equal(&state, &view->drawn_state)) {
+		all = TRUE;
+	}
+	if (all) {
+		g_free(view->drawn);
+		view->drawn = g_new(GntTextDrawnRow, MAX(height, 0));
+		view->drawn_state = state;
+
+		wbkgd(window, gnt_color_pair(GNT_COLOR_NORMAL));
+		werase(window);
+	}
+
+	text_view_update_line(view, view->bottom);
+	n = view->bottom_abs + 1;
+	if ((view->flags & GNT_TEXT_VIEW_TOP_ALIGN) && n < height) {
+		comp = height - n;
+		if (view->bottom_abs + comp >= view->total_rows) {
+			text_view_move_bottom(view, G_MAXINT);
+			comp = height - (view->bottom_abs + 1);
+		} else {
+			text_view_move_bottom(view, comp);
+			comp = 0;
+		}
+	}
+
+	/* The rows below top-aligned text are empty */
+	for (y = MAX(height - comp, 0); y < height; y++) {
+		if (!all && view->drawn[y].line != G_MAXUINT64) {
+			wattrset(window, A_NORMAL);
+			mvwhline(window, y, 0, ' ', width - has_scroll);
+			gnt_widget_queue_update_area(widget, 0, y, width - has_scroll, 1);
+		}
+		view->drawn[y].line = G_MAXUINT64;
+	}
+
+	index = view->bottom;
+	row = view->bottom_row;
+	for (i = 0; i < height && index >= 0; i++) {
+		GntTextLine *line = TEXT_LINE(view, index);
+		GntTextDrawnRow *drawn;
+		guint64 number = view->first_line + index;
+		guint start = text_line_row_start(line, row);
+		guint end = text_line_row_end(line, row);
+
+		y = height - 1 - i - comp;
+		drawn = &view->drawn[y];
+		if (all || number >= view->changed_from || drawn->line != number ||
+		    drawn->start != start || drawn->end != end) {
+			/* Nothing is left over from the row drawn before */
+			wattrset(window, A_NORMAL);
+			(void)wmove(window, y, 0);
+			text_view_draw_row(view, window, index, row);
+			wattroff(window, A_UNDERLINE | A_BLINK | A_REVERSE);
+			if (getcurx(window) < width - has_scroll)
+				whline(window, ' ', width - getcurx(window) - has_scroll);
+
+			drawn->line = number;
+			drawn->start = start;
+			drawn->end = end;
+			if (!all)
+				gnt_widget_queue_update_area(widget, 0, y, width - has_scroll, 1);
+		}
+
+		text_view_row_above(view, &index, &row);
+	}
+
+	/* And so are the rows above the first line */
+	for (y = height - 1 - i - comp; y >= 0; y--) {
+		if (!all && view->drawn[y].line != G_MAXUINT64) {
+			wattrset(window, A_NORMAL);
+			mvwhline(window, y, 0, ' ', width - has_scroll);
+			gnt_widget_queue_update_area(widget, 0, y, width - has_scroll, 1);
+		}
+		view->drawn[y].line = G_MAXUINT64;
 	}
+	view->changed_from = G_MAXUINT64;
 
-	if (has_scroll) {
+	scrcol = width - 1;
+	text_view_scrollbar(view, height, index >= 0, &bar);
+	if (has_scroll && (all || bar.position != view->drawn_scrollbar.position ||
+	                   bar.showing != view->drawn_scrollbar.showing ||
+	                   bar.up != view->drawn_scrollbar.up ||
+	                   bar.down != view->drawn_scrollbar.down)) {
+		wattrset(window, A_NORMAL);
+		if (!all) {
+			mvwvline(window, 0, scrcol, ' ', height);
+			gnt_widget_queue_update_area(widget, scrcol, 0, 1, height);
+		}
+		if (bar.showing > 0) {
+			mvwvline(window, bar.position + 1, scrcol,
+			         ACS_CKBOARD | gnt_color_pair(GNT_COLOR_HIGHLIGHT_D),
+			         bar.showing);
+		}
 		mvwaddch(window, 0, scrcol,
-		         (lines ? ACS_UARROW : ' ') |
+		         (bar.up ? ACS_UARROW : ' ') |
 		                 gnt_color_pair(GNT_COLOR_HIGHLIGHT_D));
 		mvwaddch(window, height - 1, scrcol,
-		         ((view->list && view->list->prev) ? ACS_DARROW : ' ') |
+		         (bar.down ? ACS_DARROW : ' ') |
 		                 gnt_color_pair(GNT_COLOR_HIGHLIGHT_D));
 	}
+	view->drawn_scrollbar = bar;
 
 	wmove(window, 0, 0);
 }
 
+static void
+gnt_text_view_draw(GntWidget *widget)
+{
+	text_view_draw(GNT_TEXT_VIEW(widget), TRUE);
+}
+
+static gboolean
+text_view_draw_timeout(gpointer data)
+{
+	GntTextView *view = GNT_TEXT_VIEW(data);
+	GntWidget *widget = GNT_WIDGET(view);
+
+	view->draw_timeout = 0;
+	if (!view->needs_draw || view->batch > 0)
+		return FALSE;
+
+	/* Only the rows the new text shows up in need drawing, if the view is
+	 * on screen already. Anyone connected to "draw" still gets a full draw,
+	 * so the signal is emitted as before. */
+	if (view->drawn && gnt_widget_get_mapped(widget) &&
+	    gnt_widget_get_window(widget) && !gnt_widget_get_drawing(widget) &&
+	    !g_signal_has_handler_pending(widget,
+	            g_signal_lookup("draw", GNT_TYPE_WIDGET), 0, FALSE))
+		text_view_draw(view, FALSE);
+	else
+		gnt_widget_draw(widget);
+	return FALSE;
+}
+
+/* Redraw the view once the current main loop iteration is done, so a burst of
+ * appends ends up in a single redraw. */
+static void
+text_view_queue_draw(GntTextView *view)
+{
+	view->needs_draw = TRUE;
+	if (view->batch == 0 && view->draw_timeout == 0)
+		view->draw_timeout = g_timeout_add(0, text_view_draw_timeout, view);
+}
+
+/* Redraw the view now, unless it is in a batch, which redraws it once it
+ * ends. */
+static void
+text_view_redraw(GntTextView *view)
+{
+	if (view->batch > 0)
+		text_view_queue_draw(view);
+	else
+		gnt_widget_draw(GNT_WIDGET(view));
+}
+
 static void
 gnt_text_view_size_request(GntWidget *widget)
 {
@@ -228,99 +1849,152 @@ gnt_text_view_key_pressed(G_GNUC_UNUSED GntWidget *widget,
 }
 
 static void
-free_text_line(GntTextLine *line)
+free_text_line(GntTextView *view, GntTextLine *line)
 {
-	g_list_free_full(line->segments, (GDestroyNotify)g_free);
+	text_view_release(view, line->chunk, line->text, line->len);
+	if (line->cols)
+		g_array_free(line->cols, TRUE);
+	if (line->rows)
+		g_array_free(line->rows, TRUE);
 	g_free(line);
 }
 
 static void
-free_tag(GntTextTag *tag)
+text_view_free_lines(GntTextView *view)
 {
-	g_free(tag->name);
-	g_free(tag);
+	guint i;
+
+	for (i = 0; i < view->lines.count; i++)
+		free_text_line(view, TEXT_LINE(view, i));
+	line_ring_free(&view->lines);
+	if (view->chunk) {
+		text_chunk_free(view->chunk);
+		view->chunk = NULL;
+	}
+	view->live_bytes = 0;
+	view->dead_bytes = 0;
 }
 
 static void
 gnt_text_view_destroy(GntWidget *widget)
 {
 	GntTextView *view = GNT_TEXT_VIEW(widget);
-	view->list = g_list_first(view->list);
-	g_list_free_full(view->list, (GDestroyNotify)free_text_line);
-	g_list_free_full(view->tags, (GDestroyNotify)free_tag);
-	g_string_free(view->string, TRUE);
+	if (view->draw_timeout) {
+		g_source_remove(view->draw_timeout);
+		view->draw_timeout = 0;
+	}
+	if (view->reflow_idle) {
+		g_source_remove(view->reflow_idle);
+		view->reflow_idle = 0;
+	}
+	text_view_search_free(view);
+	text_view_stream_free(view);
+	g_free(view->drawn);
+	text_view_free_lines(view);
+	text_view_clear_tags(view);
+	g_hash_table_destroy(view->tag_index);
+	if (view->text)
+		g_string_free(view->text, TRUE);
 }
 
-static char *
-gnt_text_view_get_p(GntTextView *view, int x, int y)
+static gboolean
+gnt_text_view_get_p(GntTextView *view, int x, int y, GntTextPos *pos)
 {
 	gint height;
 	int n;
 	int i = 0;
 	GntWidget *wid = GNT_WIDGET(view);
 	GntTextLine *line;
-	GList *lines;
-	GList *segs;
-	GntTextSegment *seg;
-	gchar *pos;
+	int index;
+	guint row;
+	const char *text, *p, *end;
 
-	n = g_list_length(view->list);
+	n = view->bottom_abs + 1;
 	gnt_widget_get_internal_size(wid, NULL, &height);
 	y = height - y;
 	if (n < y) {
 		x = 0;
 		y = n - 1;
 	}
+	if (y <= 0)
+		return FALSE;
+
+	text_view_update_line(view, view->bottom);
+	index = view->bottom;
+	row = view->bottom_row;
+	while (--y > 0) {
+		if (!text_view_row_above(view, &index, &row))
+			return FALSE;
+	}
 
-	lines = g_list_nth(view->list, y - 1);
-	if (!lines)
-		return NULL;
-	do {
-		line = lines->data;
-		lines = lines->next;
-	} while (line && !line->segments && lines);
+	/* Use the closest line above with some text */
+	line = TEXT_LINE(view, index);
+	while (line->len == 0 && text_view_row_above(view, &index, &row))
+		line = TEXT_LINE(view, index);
+	if (line->len == 0) /* no valid line */
+		return FALSE;
 
-	if (!line || !line->segments) /* no valid line */
-		return NULL;
-	segs = line->segments;
-	seg = (GntTextSegment *)segs->data;
-	pos = view->string->str + seg->start;
-	x = MIN(x, line->length);
-	while (++i <= x) {
-		gunichar *u;
-		pos = g_utf8_next_char(pos);
-		u = g_utf8_to_ucs4(pos, -1, NULL, NULL, NULL);
-		if (u && g_unichar_iswide(*u))
+	text = line->text;
+	p = text + text_line_row_start(line, row);
+	end = text + text_line_row_end(line, row);
+	while (++i <= x && p < end) {
+		p = g_utf8_next_char(p);
+		if (p < end && g_unichar_iswide(g_utf8_get_char(p)))
 			i++;
-		g_free(u);
 	}
-	return pos;
+	pos->line = view->first_line + index;
+	pos->offset = p - text;
+	return TRUE;
 }
 
-static GString *
-select_word_text(GntTextView *view, gchar *c)
-{
-	gchar *start = c;
-	gchar *end = c;
-	gchar *t, *endsize;
-	while ((t = g_utf8_prev_char(start))) {
-		if (!g_ascii_isspace(*t)) {
-			if (start == view->string->str)
-				break;
-			start = t;
-		} else
+/* Select the word at pos. */
+static void
+select_word(GntTextView *view, const GntTextPos *pos)
+{
+	GntTextLine *line = TEXT_LINE(view, pos->line - view->first_line);
+	const char *text = line->text;
+	guint start = pos->offset;
+	guint end = pos->offset;
+
+	while (start > 0) {
+		guint prev = g_utf8_prev_char(text + start) - text;
+		if (g_ascii_isspace(text[prev]))
 			break;
+		start = prev;
 	}
-	while ((t = g_utf8_next_char(end))) {
-		if (!g_ascii_isspace(*t))
-			end = t;
-		else
+	while (end < line->len) {
+		guint next = g_utf8_next_char(text + end) - text;
+		if (next >= line->len || g_ascii_isspace(text[next]))
 			break;
+		end = next;
+	}
+	view->select_start.line = view->select_end.line = pos->line;
+	view->select_start.offset = start;
+	view->select_end.offset = end;
+}
+
+static GString *
+select_text(GntTextView *view)
+{
+	GString *clip = g_string_new(NULL);
+	guint64 number;
+
+	for (number = view->select_start.line; number <= view->select_end.line; number++) {
+		GntTextLine *line = TEXT_LINE(view, number - view->first_line);
+		guint from = 0, to = line->len + 1;
+
+		if (number == view->select_start.line)
+			from = MIN(view->select_start.offset, line->len);
+		if (number == view->select_end.line)
+			to = text_view_select_end(view, &view->select_end);
+
+		g_string_append_len(clip, line->text + from,
+		                    MIN(to, line->len) - from);
+		if (to > line->len &&
+		    number + 1 < view->first_line + view->lines.count)
+			g_string_append_c(clip, '\n');
 	}
-	select_start = start;
-	select_end = end;
-	endsize = g_utf8_next_char(select_end); /* End at the correct byte */
-	return g_string_new_len(start, endsize - start);
+	return clip;
 }
 
 static gboolean
@@ -338,45 +2012,42 @@ gnt_text_view_clicked(GntWidget *widget, GntMouseEvent event, int x, int y)
 	} else if (event == GNT_MOUSE_SCROLL_DOWN) {
 		gnt_text_view_scroll(GNT_TEXT_VIEW(widget), 1);
 	} else if (event == GNT_LEFT_MOUSE_DOWN) {
+		GntTextView *view = GNT_TEXT_VIEW(widget);
 		gint widgetx, widgety;
 		gnt_widget_get_position(widget, &widgetx, &widgety);
-		select_start = gnt_text_view_get_p(GNT_TEXT_VIEW(widget),
-		                                   x - widgetx, y - widgety);
+		view->selected = FALSE;
+		view->selecting = gnt_text_view_get_p(view, x - widgetx, y - widgety,
+		                                      &view->select_start);
 		g_timeout_add(500, too_slow, NULL);
 	} else if (event == GNT_MOUSE_UP) {
 		GntTextView *view = GNT_TEXT_VIEW(widget);
-		if (text_view_contains(view, select_start)) {
+		if (view->selecting) {
 			GString *clip;
 			gint widgetx, widgety;
 
-			g_return_val_if_fail(select_start != NULL, TRUE);
-
+			view->selecting = FALSE;
 			gnt_widget_get_position(widget, &widgetx, &widgety);
-			select_end = gnt_text_view_get_p(view, x - widgetx,
-			                                 y - widgety);
-
-			g_return_val_if_fail(select_end != NULL, TRUE);
-
-			if (select_end < select_start) {
-				gchar *t = select_start;
-				select_start = select_end;
-				select_end = t;
+			if (!gnt_text_view_get_p(view, x - widgetx, y - widgety,
+			                         &view->select_end))
+				return TRUE;
+
+			if (text_pos_compare(&view->select_end, &view->select_start) < 0) {
+				GntTextPos t = view->select_start;
+				view->select_start = view->select_end;
+				view->select_end = t;
 			}
-			if (select_start == select_end) {
+			if (text_pos_compare(&view->select_start, &view->select_end) == 0) {
 				if (double_click) {
-					clip = select_word_text(view, select_start);
+					select_word(view, &view->select_start);
 					double_click = FALSE;
 				} else {
 					double_click = TRUE;
-					select_start = NULL;
-					select_end = NULL;
 					gnt_widget_draw(widget);
 					return TRUE;
 				}
-			} else {
-				gchar *endsize = g_utf8_next_char(select_end); /* End at the correct byte */
-				clip = g_string_new_len(select_start, endsize - select_start);
 			}
+			view->selected = TRUE;
+			clip = select_text(view);
 			gnt_widget_draw(widget);
 			gnt_set_clipboard_string(clip->str);
 			g_string_free(clip, TRUE);
@@ -386,72 +2057,49 @@ gnt_text_view_clicked(GntWidget *widget, GntMouseEvent event, int x, int y)
 	return TRUE;
 }
 
+/* Rewrap the lines for a new width. The visible lines are rewrapped right
+ * away, and the rest are left for an idle callback. Lines that get scrolled
+ * into view in the meantime are rewrapped as needed. */
 static void
 gnt_text_view_reflow(GntTextView *view)
 {
-	/* This is pretty ugly, and inefficient. Someone do something about it. */
-	GntTextLine *line;
-	GList *back, *iter, *list;
-	GString *string;
-	int pos = 0;    /* no. of 'real' lines */
-
-	list = view->list;
-	while (list->prev) {
-		line = list->data;
-		if (!line->soft)
-			pos++;
-		list = list->prev;
-	}
-
-	back = g_list_last(view->list);
-	view->list = NULL;
-
-	string = view->string;
-	view->string = NULL;
-	reset_text_view(view);
-
-	view->string = g_string_set_size(view->string, string->len);
-	view->string->len = 0;
-	gnt_widget_set_drawing(GNT_WIDGET(view), TRUE);
+	gint height;
+	int index;
+	guint rows = 0;
 
-	for (; back; back = back->prev) {
-		line = back->data;
-		if (back->next && !line->soft) {
-			gnt_text_view_append_text_with_flags(view, "\n", GNT_TEXT_FLAG_NORMAL);
-		}
+	gnt_widget_get_internal_size(GNT_WIDGET(view), NULL, &height);
 
-		for (iter = line->segments; iter; iter = iter->next) {
-			GntTextSegment *seg = iter->data;
-			char *start = string->str + seg->start;
-			char *end = string->str + seg->end;
-			char back = *end;
-			*end = '\0';
-			gnt_text_view_append_text_with_flags(view, start, seg->tvflag);
-			*end = back;
-		}
-		free_text_line(line);
+	text_view_update_line(view, view->bottom);
+	rows = view->bottom_row + 1;
+	for (index = view->bottom - 1; index >= 0 && rows < (guint)height * 2; index--) {
+		text_view_update_line(view, index);
+		rows += text_line_rows(TEXT_LINE(view, index));
 	}
-	g_list_free(list);
-
-	list = g_list_first(view->list);
-	/* Go back to the line that was in view before resizing started */
-	while (pos--) {
-		while (((GntTextLine*)list->data)->soft)
-			list = list->next;
-		list = list->next;
+	rows = text_line_rows(TEXT_LINE(view, view->bottom)) - view->bottom_row;
+	for (index = view->bottom + 1;
+	     index < (int)view->lines.count && rows < (guint)height; index++) {
+		text_view_update_line(view, index);
+		rows += text_line_rows(TEXT_LINE(view, index));
 	}
-	view->list = list;
-	gnt_widget_set_drawing(GNT_WIDGET(view), FALSE);
+
+	view->reflow_next = view->lines.count - 1;
+	if (view->reflow_idle == 0)
+		view->reflow_idle = g_idle_add(text_view_reflow_idle, view);
+
 	if (gnt_widget_get_window(GNT_WIDGET(view))) {
 		gnt_widget_draw(GNT_WIDGET(view));
 	}
-	g_string_free(string, TRUE);
 }
 
 static void
 gnt_text_view_size_changed(GntWidget *widget, int w, G_GNUC_UNUSED int h)
 {
+	GntTextView *view = GNT_TEXT_VIEW(widget);
 	gint width;
+
+	/* The window is cleared, so all of it is drawn again */
+	g_clear_pointer(&view->drawn, g_free);
+
 	gnt_widget_get_internal_size(widget, &width, NULL);
 	if (w != width && gnt_widget_get_mapped(widget)) {
 		gnt_text_view_reflow(GNT_TEXT_VIEW(widget));
@@ -462,6 +2110,7 @@ static void
 gnt_text_view_class_init(GntTextViewClass *klass)
 {
 	GntWidgetClass *widget_class = GNT_WIDGET_CLASS(klass);
+	char *style;
 
 	widget_class->destroy = gnt_text_view_destroy;
 	widget_class->draw = gnt_text_view_draw;
@@ -470,21 +2119,64 @@ gnt_text_view_class_init(GntTextViewClass *klass)
 	widget_class->key_pressed = gnt_text_view_key_pressed;
 	widget_class->clicked = gnt_text_view_clicked;
 	widget_class->size_changed = gnt_text_view_size_changed;
+
+	/**
+	 * GntTextView::search_done:
+	 * @view:   The textview
+	 * @found:  Whether a match was found
+	 *
+	 * Emitted when a search started with gnt_text_view_search() or
+	 * gnt_text_view_search_next() is done.
+	 *
+	 * Since: 3.0.0
+	 */
+	signals[SIG_SEARCH_DONE] =
+		g_signal_new("search_done",
+					 G_TYPE_FROM_CLASS(klass),
+					 G_SIGNAL_RUN_LAST,
+					 0, NULL, NULL, NULL,
+					 G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+
+	/**
+	 * GntTextView::stream_end:
+	 * @view:  The textview
+	 *
+	 * Emitted when the end of the stream attached with
+	 * gnt_text_view_attach_stream() is reached, or it can't be read anymore.
+	 *
+	 * Since: 3.0.0
+	 */
+	signals[SIG_STREAM_END] =
+		g_signal_new("stream_end",
+					 G_TYPE_FROM_CLASS(klass),
+					 G_SIGNAL_RUN_LAST,
+					 0, NULL, NULL, NULL,
+					 G_TYPE_NONE, 0);
+
+	style = gnt_style_get_from_name(NULL, "scrollback-lines");
+	default_max_lines = style ? MAX(atoi(style), 0) : 0;
+	g_free(style);
+	style = gnt_style_get_from_name(NULL, "scrollback-bytes");
+	default_max_bytes = style ? g_ascii_strtoull(style, NULL, 10) : 0;
+	g_free(style);
 }
 
 static void
 gnt_text_view_init(GntTextView *view)
 {
 	GntWidget *widget = GNT_WIDGET(view);
-	GntTextLine *line = g_new0(GntTextLine, 1);
 
 	gnt_widget_set_has_border(widget, FALSE);
 	gnt_widget_set_has_shadow(widget, FALSE);
 	gnt_widget_set_grow_x(widget, TRUE);
 	gnt_widget_set_grow_y(widget, TRUE);
 	gnt_widget_set_minimum_size(widget, 5, 2);
-	view->string = g_string_new(NULL);
-	view->list = g_list_append(view->list, line);
+	view->max_lines = default_max_lines;
+	view->max_bytes = default_max_bytes;
+	view->tag_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+	                                        (GDestroyNotify)g_queue_free);
+	g_queue_init(&view->tags);
+	reset_text_view(view);
 }
 
 /******************************************************************************
@@ -502,157 +2194,133 @@ void gnt_text_view_append_text_with_flags(GntTextView *view, const char *text, G
 	gnt_text_view_append_text_with_tag(view, text, flags, NULL);
 }
 
+/* Add some text to the last line. */
+static void
+text_view_append_to_line(GntTextView *view, const char *text, gsize len,
+                         chtype fl)
+{
+	guint index = view->lines.count - 1;
+	GntTextLine *line = TEXT_LINE(view, index);
+	guint old_len = line->len;
+
+	text_view_line_append(view, index, text, len, fl);
+	line = TEXT_LINE(view, index);
+	text_line_add_widths(line, line->text, old_len, line->len);
+
+	/* Only the last row is affected by the new text */
+	text_view_update_line(view, index);
+	text_view_wrap_line(view, index, text_line_rows(line) - 1);
+}
+
+/* The position at the end of the text. */
+static GntTextPos
+text_view_end(GntTextView *view)
+{
+	GntTextPos pos;
+
+	pos.line = view->first_line + view->lines.count - 1;
+	pos.offset = TEXT_LINE(view, view->lines.count - 1)->len;
+	return pos;
+}
+
+/* Add some text, without newlines, to the end of the view. */
+static void
+text_view_append(GntTextView *view, const char *text, gsize len, chtype fl)
+{
+	text_view_append_to_line(view, text, len, fl);
+	text_view_drop_text(view);
+}
+
+/* Start a new line at the end of the view. */
+static void
+text_view_break_line(GntTextView *view)
+{
+	text_view_add_line(view);
+	text_view_drop_text(view);
+}
+
 void gnt_text_view_append_text_with_tag(GntTextView *view, const char *text,
 			GntTextFormatFlags flags, const char *tagname)
 {
-	GntWidget *widget = GNT_WIDGET(view);
-	gint widget_width;
 	chtype fl = 0;
 	const char *start, *end;
-	GList *list = view->list;
-	GntTextLine *line;
-	int len;
-	gboolean has_scroll = !(view->flags & GNT_TEXT_VIEW_NO_SCROLL);
-	gboolean wrap_word = !(view->flags & GNT_TEXT_VIEW_WRAP_CHAR);
+	GntTextPos tag_start, tag_end;
 
 	if (text == NULL || *text == '\0')
 		return;
 
-	gnt_widget_get_internal_size(widget, &widget_width, NULL);
 	fl = gnt_text_format_flag_to_chtype(flags);
+	tag_start = text_view_end(view);
 
-	len = view->string->len;
-	view->string = g_string_append(view->string, text);
-
-	if (tagname) {
-		GntTextTag *tag = g_new0(GntTextTag, 1);
-		tag->name = g_strdup(tagname);
-		tag->start = len;
-		tag->end = view->string->len;
-		view->tags = g_list_append(view->tags, tag);
-	}
-
-	view->list = g_list_first(view->list);
-
-	start = end = view->string->str + len;
-
+	start = text;
 	while (*start) {
-		GntTextLine *oldl;
-		GntTextSegment *seg = NULL;
-
-		if (*end == '\n' || *end == '\r') {
-			if (!strncmp(end, "\r\n", 2))
-				end++;
-			end++;
-			start = end;
-			gnt_text_view_next_line(view);
-			view->list = g_list_first(view->list);
+		if (*start == '\n' || *start == '\r') {
+			if (!strncmp(start, "\r\n", 2))
+				start++;
+			start++;
+			text_view_break_line(view);
 			continue;
 		}
 
-		line = view->list->data;
-		if (line->length == widget_width - has_scroll) {
-			/* The last added line was exactly the same width as the widget */
-			line = g_new0(GntTextLine, 1);
-			line->soft = TRUE;
-			view->list = g_list_prepend(view->list, line);
-		}
-
-		if ((end = strchr(start, '\r')) != NULL ||
-			(end = strchr(start, '\n')) != NULL) {
-			len = gnt_util_onscreen_width(start, end - has_scroll);
-			if (widget_width > 0 &&
-			    len >= widget_width - line->length - has_scroll) {
-				end = NULL;
-			}
-		}
-
-		if (end == NULL)
-			end = gnt_util_onscreen_width_to_pointer(
-			        start, widget_width - line->length - has_scroll,
-			        &len);
-
-		/* Try to append to the previous segment if possible */
-		if (line->segments) {
-			seg = g_list_last(line->segments)->data;
-			if (seg->flags != fl)
-				seg = NULL;
-		}
-
-		if (seg == NULL) {
-			seg = g_new0(GntTextSegment, 1);
-			seg->start = start - view->string->str;
-			seg->tvflag = flags;
-			seg->flags = fl;
-			line->segments = g_list_append(line->segments, seg);
-		}
-
-		oldl = line;
-		if (wrap_word && *end && *end != '\n' && *end != '\r') {
-			const char *tmp = end;
-			while (end && *end != '\n' && *end != '\r' && !g_ascii_isspace(*end)) {
-				end = g_utf8_find_prev_char(seg->start + view->string->str, end);
-			}
-			if (!end || !g_ascii_isspace(*end))
-				end = tmp;
-			else
-				end++; /* Remove the space */
-
-			line = g_new0(GntTextLine, 1);
-			line->soft = TRUE;
-			view->list = g_list_prepend(view->list, line);
-		}
-		seg->end = end - view->string->str;
-		oldl->length += len;
+		end = start + strcspn(start, "\r\n");
+		text_view_append(view, start, end - start, fl);
 		start = end;
 	}
 
-	view->list = list;
+	if (tagname) {
+		tag_end = text_view_end(view);
+		text_view_add_tag(view, tagname, &tag_start, &tag_end);
+	}
 
-	gnt_widget_draw(widget);
+	text_view_trim_scrollback(view);
+	text_view_queue_draw(view);
 }
 
+/* The lines are joined into a single string only when somebody asks for it,
+ * and it is then kept up to date as text is appended. */
 const gchar *
 gnt_text_view_get_text(GntTextView *view)
 {
+	guint i;
+
 	g_return_val_if_fail(GNT_IS_TEXT_VIEW(view), NULL);
 
-	return view->string->str;
+	if (view->text)
+		return view->text->str;
+
+	view->text = g_string_sized_new(view->live_bytes + view->lines.count);
+	for (i = 0; i < view->lines.count; i++) {
+		GntTextLine *line = TEXT_LINE(view, i);
+		if (i > 0)
+			g_string_append_c(view->text, '\n');
+		g_string_append_len(view->text, line->text, line->len);
+	}
+	return view->text->str;
 }
 
 void gnt_text_view_scroll(GntTextView *view, int scroll)
 {
 	if (scroll == 0)
 	{
-		view->list = g_list_first(view->list);
-	}
-	else if (scroll > 0)
-	{
-		GList *list = g_list_nth_prev(view->list, scroll);
-		if (list == NULL)
-			list = g_list_first(view->list);
-		view->list = list;
+		view->bottom = view->lines.count - 1;
+		view->bottom_row = 0;
+		view->bottom_abs = view->total_rows - text_line_rows(TEXT_LINE(view, view->bottom));
+		text_view_move_bottom(view, G_MAXINT);
 	}
-	else if (scroll < 0)
+	else
 	{
-		GList *list = g_list_nth(view->list, -scroll);
-		if (list == NULL)
-			list = g_list_last(view->list);
-		view->list = list;
+		text_view_move_bottom(view, scroll);
 	}
 
-	gnt_widget_draw(GNT_WIDGET(view));
+	text_view_redraw(view);
 }
 
 void gnt_text_view_next_line(GntTextView *view)
 {
-	GntTextLine *line = g_new0(GntTextLine, 1);
-	GList *list = view->list;
+	text_view_break_line(view);
+	text_view_trim_scrollback(view);
 
-	view->list = g_list_prepend(g_list_first(view->list), line);
-	view->list = list; // -V519
-
-	gnt_widget_draw(GNT_WIDGET(view));
+	text_view_queue_draw(view);
 }
 
 chtype gnt_text_format_flag_to_chtype(GntTextFormatFlags flags)
@@ -680,149 +2348,94 @@ chtype gnt_text_format_flag_to_chtype(GntTextFormatFlags flags)
 
 static void reset_text_view(GntTextView *view)
 {
-	GntTextLine *line;
-
-	g_list_free_full(view->list, (GDestroyNotify)free_text_line);
-	view->list = NULL;
-
-	line = g_new0(GntTextLine, 1);
-	view->list = g_list_append(view->list, line);
-	if (view->string)
-		g_string_free(view->string, TRUE);
-	view->string = g_string_new(NULL);
+	if (view->lines.data)
+		text_view_free_lines(view);
+	line_ring_init(&view->lines);
+	view->bottom = 0;
+	view->bottom_row = 0;
+	view->bottom_abs = 0;
+	view->total_rows = 0;
+	view->reflow_next = -1;
+
+	text_view_drop_text(view);
+	view->first_line = 0;
+	view->changed_from = 0;
+
+	view->selecting = FALSE;
+	view->selected = FALSE;
+	text_view_clear_tags(view);
+	text_view_search_free(view);
+
+	text_view_add_line(view);
 }
 
 void gnt_text_view_clear(GntTextView *view)
 {
 	reset_text_view(view);
 
-	g_list_free_full(view->tags, (GDestroyNotify)free_tag);
-	view->tags = NULL;
-
 	if (gnt_widget_get_window(GNT_WIDGET(view))) {
-		gnt_widget_draw(GNT_WIDGET(view));
+		text_view_redraw(view);
 	}
 }
 
 int gnt_text_view_get_lines_below(GntTextView *view)
 {
-	int below = 0;
-	GList *list = view->list;
-	while ((list = list->prev))
-		++below;
-	return below;
+	return view->total_rows - 1 - view->bottom_abs;
 }
 
 int gnt_text_view_get_lines_above(GntTextView *view)
 {
-	int above = 0;
 	gint height;
-	GList *list;
 	gnt_widget_get_internal_size(GNT_WIDGET(view), NULL, &height);
-	list = g_list_nth(view->list, height);
-	if (!list)
-		return 0;
-	while ((list = list->next))
-		++above;
-	return above;
+	return MAX((int)view->bottom_abs - height, 0);
 }
 
-/*
- * XXX: There are quite possibly more than a few bugs here.
- */
+/* The tags are looked up by name, and a change only touches the lines of the
+ * tag and the tags that follow it on those lines. The tags further down are
+ * only renumbered if lines were added or removed. Then the ring moves all of
+ * the later lines too, which is O(lines after the tag); keeping the lines in
+ * a gap buffer and the tags renumbered lazily would avoid that, but changes
+ * that add or remove lines are rare next to the ones that don't. */
 int gnt_text_view_tag_change(GntTextView *view, const char *name, const char *text, gboolean all)
 {
-	GList *alllines = g_list_first(view->list);
-	GList *list, *next, *iter, *inext;
-	const int text_length = text ? strlen(text) : 0;
+	GQueue *queue;
+	GList *list, *next, *iter;
 	int count = 0;
-	for (list = view->tags; list; list = next) {
-		GntTextTag *tag = list->data;
-		next = list->next;
-		if (strcmp(tag->name, name) == 0) {
-			int change;
-			char *before, *after;
-
-			count++;
-
-			before = g_strndup(view->string->str, tag->start);
-			after = g_strdup(view->string->str + tag->end);
-			change = (tag->end - tag->start) - text_length;
 
-			g_string_printf(view->string, "%s%s%s", before, text ? text : "", after);
-			g_free(before);
-			g_free(after);
-
-			/* Update the offsets of the next tags */
-			for (iter = next; iter; iter = iter->next) {
-				GntTextTag *t = iter->data;
-				t->start -= change;
-				t->end -= change;
-			}
-
-			/* Update the offsets of the segments */
-			for (iter = alllines; iter; iter = inext) {
-				GList *segs, *snext;
-				GntTextLine *line = iter->data;
-				inext = iter->next;
+	queue = g_hash_table_lookup(view->tag_index, name);
+	for (list = queue ? queue->head : NULL; list; list = next) {
+		GntTextTag *tag = list->data;
+		GntTextPos from = tag->start, to = tag->end, end;
 
-				if (G_UNLIKELY(line == NULL)) {
-					g_warn_if_reached();
-					continue;
-				}
+		next = list->next;
+		count++;
 
-				for (segs = line->segments; line && segs; segs = snext) {
-					GntTextSegment *seg = segs->data;
-
-					snext = segs->next;
-					if (seg->start >= tag->end) {
-						/* The segment is somewhere after the tag */
-						seg->start -= change;
-						seg->end -= change;
-					} else if (seg->end <= tag->start) {
-						/* This segment is somewhere in front of the tag */
-					} else if (seg->start >= tag->start) {
-						/* This segment starts in the middle of the tag */
-						if (text == NULL) {
-							g_free(seg);
-							line->segments = g_list_delete_link(line->segments, segs);
-							if (line->segments == NULL) {
-								free_text_line(line);
-								line = NULL;
-								if (view->list == iter) {
-									if (inext)
-										view->list = inext;
-									else
-										view->list = iter->prev;
-								}
-								alllines = g_list_delete_link(alllines, iter);
-							}
-						} else {
-							/* XXX: (null) */
-							seg->start = tag->start;
-							seg->end = tag->end - change;
-						}
-						if (line)
-							line->length -= change;
-						/* XXX: Make things work if the tagged text spans over several lines. */
-					} else {
-						/* XXX: handle the rest of the conditions */
-						gnt_warning("WTF! This needs to be handled properly!!%s", "");
-					}
-				}
-			}
-			if (text == NULL) {
-				/* Remove the tag */
-				view->tags = g_list_delete_link(view->tags, list);
-				free_tag(tag);
-			} else {
-				tag->end -= change;
-			}
-			if (!all)
+		end = text_view_splice(view, &from, &to, text);
+		for (iter = tag->link->next; iter; iter = iter->next) {
+			GntTextTag *t = iter->data;
+			if (t->start.line > to.line && end.line == to.line)
 				break;
+			text_pos_splice(&t->start, &from, &to, &end);
+			text_pos_splice(&t->end, &from, &to, &end);
+		}
+		text_pos_splice(&view->select_start, &from, &to, &end);
+		text_pos_splice(&view->select_end, &from, &to, &end);
+		text_view_search_splice(view, &from, &to, &end);
+
+		if (text == NULL) {
+			text_view_remove_tag(view, tag);
+		} else {
+			tag->end = end;
 		}
+		if (!all)
+			break;
+	}
+
+	if (count > 0) {
+		text_view_drop_text(view);
+		text_view_compact(view);
 	}
-	gnt_widget_draw(GNT_WIDGET(view));
+	text_view_redraw(view);
 	return count;
 }
 
@@ -854,7 +2467,458 @@ void gnt_text_view_attach_scroll_widget(GntTextView *view, GntWidget *widget)
 
 void gnt_text_view_set_flag(GntTextView *view, GntTextViewFlag flag)
 {
+	GntTextViewFlag old = view->flags;
+
 	view->flags |= flag;
+	if ((old ^ view->flags) & (GNT_TEXT_VIEW_NO_SCROLL | GNT_TEXT_VIEW_WRAP_CHAR))
+		gnt_text_view_reflow(view);
+}
+
+void
+gnt_text_view_set_scrollback(GntTextView *view, guint max_lines, gsize max_bytes)
+{
+	g_return_if_fail(GNT_IS_TEXT_VIEW(view));
+
+	view->max_lines = max_lines;
+	view->max_bytes = max_bytes;
+	text_view_trim_scrollback(view);
+	if (gnt_widget_get_window(GNT_WIDGET(view))) {
+		text_view_redraw(view);
+	}
+}
+
+void
+gnt_text_view_get_scrollback(GntTextView *view, guint *max_lines, gsize *max_bytes)
+{
+	g_return_if_fail(GNT_IS_TEXT_VIEW(view));
+
+	if (max_lines)
+		*max_lines = view->max_lines;
+	if (max_bytes)
+		*max_bytes = view->max_bytes;
+}
+
+void
+gnt_text_view_begin_batch(GntTextView *view)
+{
+	g_return_if_fail(GNT_IS_TEXT_VIEW(view));
+
+	view->batch++;
+}
+
+void
+gnt_text_view_end_batch(GntTextView *view)
+{
+	g_return_if_fail(GNT_IS_TEXT_VIEW(view));
+	g_return_if_fail(view->batch > 0);
+
+	view->batch--;
+	if (view->batch == 0 && view->needs_draw)
+		text_view_queue_draw(view);
+}
+
+/* A forward search starts at the top of the view, and a backward search at
+ * the bottom. */
+gboolean
+gnt_text_view_search(GntTextView *view, const char *pattern,
+                     GntTextSearchFlags flags, GError **error)
+{
+	GntTextSearch *search;
+	GRegex *regex = NULL, *raw_regex = NULL;
+	gboolean caseless = (flags & GNT_TEXT_SEARCH_CASE_INSENSITIVE) != 0;
+	gint height;
+	int index;
+	guint row;
+
+	g_return_val_if_fail(GNT_IS_TEXT_VIEW(view), FALSE);
+	g_return_val_if_fail(pattern != NULL && *pattern != '\0', FALSE);
+
+	/* Plain text is looked for directly, unless the case has to be folded
+	 * beyond ASCII, which is left to GRegex. */
+	if ((flags & GNT_TEXT_SEARCH_REGEX) || (caseless && !g_str_is_ascii(pattern))) {
+		char *escaped = NULL;
+		GRegexCompileFlags compile =
+		        G_REGEX_OPTIMIZE | (caseless ? G_REGEX_CASELESS : 0);
+
+		if (!(flags & GNT_TEXT_SEARCH_REGEX))
+			pattern = escaped = g_regex_escape_string(pattern, -1);
+		regex = g_regex_new(pattern, compile, G_REGEX_MATCH_NOTEMPTY, error);
+		if (regex) {
+			raw_regex = g_regex_new(pattern, compile | G_REGEX_RAW,
+			                        G_REGEX_MATCH_NOTEMPTY, error);
+			if (raw_regex == NULL)
+				g_clear_pointer(&regex, g_regex_unref);
+		}
+		g_free(escaped);
+		if (regex == NULL)
+			return FALSE;
+	}
+
+	text_view_search_free(view);
+	search = view->search = g_new0(GntTextSearch, 1);
+	search->flags = flags;
+	search->regex = regex;
+	search->raw_regex = raw_regex;
+	if (regex == NULL) {
+		search->needle = g_strdup(pattern);
+		search->needle_len = strlen(pattern);
+	}
+
+	text_view_update_line(view, view->bottom);
+	index = view->bottom;
+	row = view->bottom_row;
+	if (flags & GNT_TEXT_SEARCH_BACKWARD) {
+		search->pos.offset = text_line_row_end(TEXT_LINE(view, index), row);
+	} else {
+		gnt_widget_get_internal_size(GNT_WIDGET(view), NULL, &height);
+		while (--height > 0 && text_view_row_above(view, &index, &row))
+			;
+		if (index < 0) {
+			index = 0;
+			row = 0;
+		}
+		search->pos.offset = text_line_row_start(TEXT_LINE(view, index), row);
+	}
+	search->pos.line = view->first_line + index;
+
+	text_view_search_start(view);
+	return TRUE;
+}
+
+void
+gnt_text_view_search_next(GntTextView *view)
+{
+	g_return_if_fail(GNT_IS_TEXT_VIEW(view));
+	g_return_if_fail(view->search != NULL);
+
+	text_view_search_start(view);
+}
+
+void
+gnt_text_view_search_cancel(GntTextView *view)
+{
+	g_return_if_fail(GNT_IS_TEXT_VIEW(view));
+
+	if (view->search == NULL)
+		return;
+	text_view_search_free(view);
+	if (gnt_widget_get_window(GNT_WIDGET(view))) {
+		gnt_widget_draw(GNT_WIDGET(view));
+	}
+}
+
+/* A match never spans lines, as each line is searched on its own. */
+gboolean
+gnt_text_view_get_search_match(GntTextView *view, guint *line,
+                               gsize *start, gsize *end)
+{
+	GntTextSearch *search;
+
+	g_return_val_if_fail(GNT_IS_TEXT_VIEW(view), FALSE);
+
+	search = view->search;
+	if (search == NULL || !search->matched)
+		return FALSE;
+
+	if (line)
+		*line = search->match_start.line - view->first_line;
+	if (start)
+		*start = search->match_start.offset;
+	if (end)
+		*end = search->match_end.offset;
+	return TRUE;
+}
+
+/******************************************************************************
+ * Streams
+ *****************************************************************************/
+/* Where the text stops being complete UTF-8, because the last character is
+ * cut off. */
+static const char *
+text_utf8_complete_end(const char *start, const char *end)
+{
+	const char *p = end;
+
+	while (p > start && end - p < 4) {
+		p--;
+		if ((*p & 0xc0) != 0x80) {
+			if ((*p & 0x80) && p + g_utf8_skip[*(const guchar *)p] > end)
+				return p;
+			break;
+		}
+	}
+	return end;
+}
+
+/* Apply the parameters of an SGR escape sequence. Colours are skipped, as
+ * the colours of the view come from the colour scheme. */
+static void
+text_stream_sgr(GntTextStream *stream, const char *p, const char *end)
+{
+	int skip = 0;        /* Parameters of an extended colour left to skip */
+	gboolean ext = FALSE;
+
+	for (;;) {
+		int n = 0;
+
+		for (; p < end && g_ascii_isdigit(*p); p++)
+			n = MIN(n * 10 + (*p - '0'), 1000);
+
+		if (skip > 0) {
+			skip--;
+		} else if (ext) {
+			skip = n == 5 ? 1 : n == 2 ? 3 : 0;
+			ext = FALSE;
+		} else switch (n) {
+			case 0:
+				stream->format = GNT_TEXT_FLAG_NORMAL;
+				stream->attr = 0;
+				break;
+			case 1: stream->format |= GNT_TEXT_FLAG_BOLD; break;
+			case 2: stream->format |= GNT_TEXT_FLAG_DIM; break;
+			case 4: stream->format |= GNT_TEXT_FLAG_UNDERLINE; break;
+			case 5: case 6: stream->format |= GNT_TEXT_FLAG_BLINK; break;
+			case 7: stream->attr |= A_REVERSE; break;
+			case 22: stream->format &= ~(GNT_TEXT_FLAG_BOLD | GNT_TEXT_FLAG_DIM); break;
+			case 24: stream->format &= ~GNT_TEXT_FLAG_UNDERLINE; break;
+			case 25: stream->format &= ~GNT_TEXT_FLAG_BLINK; break;
+			case 27: stream->attr &= ~A_REVERSE; break;
+			case 38: case 48: ext = TRUE; break;
+			default: break;
+		}
+
+		if (p >= end)
+			break;
+		p++;
+	}
+}
+
+/* Skip an escape sequence, applying it if it sets text attributes. Returns
+ * NULL if the sequence is cut off at the end of the text. */
+static const char *
+text_stream_escape(GntTextStream *stream, const char *p, const char *end)
+{
+	const char *params;
+
+	/* p is at the ESC */
+	if (++p == end)
+		return NULL;
+	if (*p == ']') {
+		/* An operating system command, which runs up to a BEL or ST */
+		for (; p < end; p++) {
+			if (*p == '\n')
+				return p;  /* Don't let a broken one take the text with it */
+			if (*p == '\a')
+				return p + 1;
+			if (*p == '\033' && p + 1 < end && p[1] == '\\')
+				return p + 2;
+		}
+		return NULL;
+	}
+	if (*p != '[') {
+		/* Intermediate bytes, then the final byte */
+		while (p < end && *p >= 0x20 && *p <= 0x2f)
+			p++;
+		if (p == end)
+			return NULL;
+		return (*p >= 0x30 && *p <= 0x7e) ? p + 1 : p;
+	}
+
+	params = ++p;
+	while (p < end && *p >= 0x20 && *p <= 0x3f)
+		p++;
+	if (p == end)
+		return NULL;
+	if (*p < 0x40 || *p > 0x7e) {
+		/* Not an escape sequence after all */
+		return p;
+	}
+	if (*p == 'm')
+		text_stream_sgr(stream, params, p);
+	return p + 1;
+}
+
+/* Add the text read from the stream to the view. Returns the number of bytes
+ * used. The rest is an incomplete character or escape sequence, which is
+ * kept for the next read, unless it is the end of the stream. */
+static gsize
+text_view_stream_parse(GntTextView *view, GntTextStream *stream,
+                       const char *text, gsize len, gboolean eof)
+{
+	const char *p = text, *end = text + len;
+	const char *special;
+
+	/* The text ends with a nul, so strcspn stops there too */
+	special = (stream->flags & GNT_TEXT_STREAM_ANSI) ? "\r\n\033" : "\r\n";
+	while (p < end) {
+		const char *q = p + strcspn(p, special), *next;
+
+		if (q == end && !eof)
+			q = text_utf8_complete_end(p, end);
+		if (q > p) {
+			text_view_append(view, p, q - p,
+			        gnt_text_format_flag_to_chtype(stream->format) | stream->attr);
+			stream->cr = FALSE;
+		}
+		if (q == end || (*q & 0x80))
+			return q - text;
+
+		switch (*q) {
+			case '\n':
+				if (!stream->cr)
+					text_view_break_line(view);
+				stream->cr = FALSE;
+				next = q + 1;
+				break;
+			case '\r':
+				text_view_break_line(view);
+				stream->cr = TRUE;
+				next = q + 1;
+				break;
+			case '\033':
+				next = text_stream_escape(stream, q, end);
+				if (next == NULL) {
+					if (!eof && end - q < STREAM_ESCAPE_MAX)
+						return q - text;
+					next = q + 1;
+				}
+				break;
+			default:
+				/* There is no place for a nul in the text */
+				next = q + 1;
+				break;
+		}
+		p = next;
+	}
+	return p - text;
+}
+
+static gboolean
+text_view_stream_read(GIOChannel *channel, G_GNUC_UNUSED GIOCondition cond,
+                      gpointer data)
+{
+	GntTextView *view = GNT_TEXT_VIEW(data);
+	GntTextStream *stream = view->stream;
+	gboolean done = FALSE;
+	int i;
+
+	if (!gnt_widget_get_mapped(GNT_WIDGET(view)) ||
+	    !gnt_widget_get_visible(GNT_WIDGET(view))) {
+		/* Nobody would see the text, so let the writer wait. Reading goes on
+		 * once the view is drawn again. */
+		stream->watch = 0;
+		return FALSE;
+	}
+
+	for (i = 0; i < STREAM_READS && !done; i++) {
+		GIOStatus status;
+		gsize count = 0, used;
+
+		status = g_io_channel_read_chars(channel,
+		                                 stream->buffer + stream->pending,
+		                                 STREAM_BUFFER - stream->pending,
+		                                 &count, NULL);
+		done = (status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR);
+
+		count += stream->pending;
+		stream->buffer[count] = '\0';
+		used = text_view_stream_parse(view, stream, stream->buffer, count, done);
+		stream->pending = count - used;
+		memmove(stream->buffer, stream->buffer + used, stream->pending);
+
+		if (status == G_IO_STATUS_AGAIN)
+			break;
+	}
+
+	text_view_trim_scrollback(view);
+	text_view_queue_draw(view);
+
+	if (done) {
+		stream->watch = 0;
+		text_view_stream_free(view);
+		g_signal_emit(view, signals[SIG_STREAM_END], 0);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Start reading from the stream, unless the view is hidden. */
+static void
+text_view_stream_watch(GntTextView *view)
+{
+	GntTextStream *stream = view->stream;
+
+	if (stream == NULL || stream->watch != 0 ||
+	    !gnt_widget_get_mapped(GNT_WIDGET(view)) ||
+	    !gnt_widget_get_visible(GNT_WIDGET(view)))
+		return;
+	stream->watch = g_io_add_watch(stream->channel,
+	                               G_IO_IN | G_IO_HUP | G_IO_ERR,
+	                               text_view_stream_read, view);
+}
+
+static void
+text_view_stream_free(GntTextView *view)
+{
+	GntTextStream *stream = view->stream;
+
+	if (stream == NULL)
+		return;
+	if (stream->watch)
+		g_source_remove(stream->watch);
+	g_io_channel_unref(stream->channel);
+	g_free(stream);
+	view->stream = NULL;
+}
+
+void
+gnt_text_view_attach_stream(GntTextView *view, GIOChannel *channel,
+                            GntTextStreamFlags flags)
+{
+	GntTextStream *stream;
+
+	g_return_if_fail(GNT_IS_TEXT_VIEW(view));
+	g_return_if_fail(channel != NULL);
+
+	text_view_stream_free(view);
+
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+	g_io_channel_set_flags(channel,
+	                       g_io_channel_get_flags(channel) | G_IO_FLAG_NONBLOCK,
+	                       NULL);
+
+	stream = g_new0(GntTextStream, 1);
+	stream->channel = g_io_channel_ref(channel);
+	stream->flags = flags;
+	view->stream = stream;
+	text_view_stream_watch(view);
+}
+
+void
+gnt_text_view_attach_fd(GntTextView *view, int fd, GntTextStreamFlags flags)
+{
+	GIOChannel *channel;
+
+	g_return_if_fail(GNT_IS_TEXT_VIEW(view));
+	g_return_if_fail(fd >= 0);
+
+#ifdef _WIN32
+	channel = g_io_channel_win32_new_fd(fd);
+#else
+	channel = g_io_channel_unix_new(fd);
+#endif
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	gnt_text_view_attach_stream(view, channel, flags);
+	g_io_channel_unref(channel);
+}
+
+void
+gnt_text_view_detach_stream(GntTextView *view)
+{
+	g_return_if_fail(GNT_IS_TEXT_VIEW(view));
+
+	text_view_stream_free(view);
 }
 
 /* Pager and editor setups */
@@ -907,6 +2971,7 @@ check_for_ext_cb(GntWidget *widget, const char *key, GntTextView *view)
 	FILE *file;
 	gboolean ret;
 	gboolean pg;
+	guint i;
 
 	if (pager == NULL) {
 		pager = gnt_key_translate(gnt_style_get_from_name("pager", "key"));
@@ -935,7 +3000,12 @@ check_for_ext_cb(GntWidget *widget, const char *key, GntTextView *view)
 	file = fdopen(g_mkstemp(path), "wb");
 	if (!file)
 		return FALSE;
-	fprintf(file, "%s", view->string->str);
+	for (i = 0; i < view->lines.count; i++) {
+		GntTextLine *line = TEXT_LINE(view, i);
+		if (i > 0)
+			fputc('\n', file);
+		fwrite(line->text, 1, line->len, file);
+	}
 	fclose(file);
 
 	pageditor.tv = view;
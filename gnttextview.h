@@ -75,6 +75,38 @@ typedef enum
 	GNT_TEXT_FLAG_HIGHLIGHT   = 1 << 4,
 } GntTextFormatFlags;
 
+/**
+ * GntTextSearchFlags:
+ * @GNT_TEXT_SEARCH_BACKWARD: Search towards the start of the text.
+ * @GNT_TEXT_SEARCH_CASE_INSENSITIVE: Ignore differences in case.
+ * @GNT_TEXT_SEARCH_REGEX: The pattern is a #GRegex regular expression.
+ *
+ * Flags that determine how gnt_text_view_search() searches the text.
+ *
+ * Since: 3.0.0
+ */
+typedef enum
+{
+	GNT_TEXT_SEARCH_BACKWARD         = 1 << 0,
+	GNT_TEXT_SEARCH_CASE_INSENSITIVE = 1 << 1,
+	GNT_TEXT_SEARCH_REGEX            = 1 << 2,
+} GntTextSearchFlags;
+
+/**
+ * GntTextStreamFlags:
+ * @GNT_TEXT_STREAM_ANSI: Interpret ANSI escape sequences that set text
+ *                        attributes (SGR), and drop other escape sequences.
+ *
+ * Flags that determine how text read from a stream is added to a
+ * #GntTextView.
+ *
+ * Since: 3.0.0
+ */
+typedef enum
+{
+	GNT_TEXT_STREAM_ANSI = 1 << 0,
+} GntTextStreamFlags;
+
 G_BEGIN_DECLS
 
 /**
@@ -108,7 +140,8 @@ void gnt_text_view_scroll(GntTextView *view, int scroll);
  * @text:   The text to append to the textview.
  * @flags:  The text-flags to apply to the new text.
  *
- * Append new text in a textview.
+ * Append new text in a textview. The textview is redrawn once control
+ * returns to the main loop, so consecutive appends are drawn together.
  */
 void gnt_text_view_append_text_with_flags(GntTextView *view, const char *text, GntTextFormatFlags flags);
 
@@ -127,9 +160,11 @@ void gnt_text_view_append_text_with_tag(GntTextView *view, const char *text, Gnt
  * gnt_text_view_get_text:
  * @view:   The textview.
  *
- * Get the text of the textview.
+ * Get the text of the textview. The lines are separated by '\n', however
+ * they ended in the text that was added.
  *
- * Returns: The text.
+ * Returns: The text. It belongs to the textview, and is only valid until the
+ *          text of the textview changes.
  *
  * Since: 2.14.0
  */
@@ -192,6 +227,11 @@ int gnt_text_view_get_lines_above(GntTextView *view);
  *
  * Change the text of a tag.
  *
+ * This takes time in proportion to the lines of the tag. If the new text
+ * has more or fewer lines than the old one, every line and tag after it is
+ * moved as well, so such a change near the top of a long scrollback costs
+ * as much as the rest of the scrollback.
+ *
  * Returns:  The number of instances changed.
  */
 int gnt_text_view_tag_change(GntTextView *view, const char *name, const char *text, gboolean all);
@@ -257,6 +297,175 @@ void gnt_text_view_attach_editor_widget(GntTextView *view, GntWidget *widget);
  */
 void gnt_text_view_set_flag(GntTextView *view, GntTextViewFlag flag);
 
+/**
+ * gnt_text_view_set_scrollback:
+ * @view:       The textview widget
+ * @max_lines:  The maximum number of lines to keep, or 0 for no limit
+ * @max_bytes:  The maximum number of bytes of text to keep, or 0 for no limit
+ *
+ * Limit the amount of text kept in the textview. When a limit is exceeded, the
+ * oldest lines are dropped. Wrapped lines are counted as a single line.
+ *
+ * The default limits can be set in ~/.gntrc:
+ *
+ * <programlisting>
+ * [general]
+ * scrollback-lines = 10000
+ * scrollback-bytes = 1048576
+ * </programlisting>
+ *
+ * Since: 3.0.0
+ */
+void gnt_text_view_set_scrollback(GntTextView *view, guint max_lines, gsize max_bytes);
+
+/**
+ * gnt_text_view_get_scrollback:
+ * @view:       The textview widget
+ * @max_lines:  (out) (optional): Return location for the maximum number of lines
+ * @max_bytes:  (out) (optional): Return location for the maximum number of bytes
+ *
+ * Get the scrollback limits of the textview. See gnt_text_view_set_scrollback().
+ *
+ * Since: 3.0.0
+ */
+void gnt_text_view_get_scrollback(GntTextView *view, guint *max_lines, gsize *max_bytes);
+
+/**
+ * gnt_text_view_begin_batch:
+ * @view:  The textview widget
+ *
+ * Start a batch of changes to the textview. Appending text, scrolling,
+ * changing tags, clearing and setting the scrollback don't redraw the textview
+ * until the matching call to gnt_text_view_end_batch(). This is useful when
+ * adding a lot of text at once, for example when loading a history. The
+ * textview is still drawn when its window is.
+ *
+ * Batches can be nested.
+ *
+ * Since: 3.0.0
+ */
+void gnt_text_view_begin_batch(GntTextView *view);
+
+/**
+ * gnt_text_view_end_batch:
+ * @view:  The textview widget
+ *
+ * End a batch of changes started with gnt_text_view_begin_batch(). The
+ * textview is redrawn once the outermost batch ends.
+ *
+ * Since: 3.0.0
+ */
+void gnt_text_view_end_batch(GntTextView *view);
+
+/**
+ * gnt_text_view_search:
+ * @view:     The textview widget
+ * @pattern:  The text to look for
+ * @flags:    How to search
+ * @error:    (out) (optional): Return location for an error
+ *
+ * Search the textview for some text. A forward search starts at the top of the
+ * view, and a backward search at its bottom. The search runs in the
+ * background, so it does not hold up the main loop even if there is a lot of
+ * text. When it is done, the textview emits #GntTextView::search_done. The
+ * match is highlighted and scrolled into view.
+ *
+ * Matches do not span lines. Only one search runs at a time, so this cancels
+ * the previous search.
+ *
+ * Returns: %FALSE if @pattern is not a valid regular expression.
+ *
+ * Since: 3.0.0
+ */
+gboolean gnt_text_view_search(GntTextView *view, const char *pattern, GntTextSearchFlags flags, GError **error);
+
+/**
+ * gnt_text_view_search_next:
+ * @view:  The textview widget
+ *
+ * Look for the next match of the search started with gnt_text_view_search(),
+ * in the same direction. The textview emits #GntTextView::search_done once
+ * the search is done.
+ *
+ * Since: 3.0.0
+ */
+void gnt_text_view_search_next(GntTextView *view);
+
+/**
+ * gnt_text_view_search_cancel:
+ * @view:  The textview widget
+ *
+ * Stop searching and remove the highlight from the match.
+ *
+ * Since: 3.0.0
+ */
+void gnt_text_view_search_cancel(GntTextView *view);
+
+/**
+ * gnt_text_view_get_search_match:
+ * @view:   The textview widget
+ * @line:   (out) (optional): Return location for the line of the match
+ * @start:  (out) (optional): Return location for the start of the match
+ * @end:    (out) (optional): Return location for the end of the match
+ *
+ * Get the current match of the search. The line is counted from the first
+ * line of the text returned by gnt_text_view_get_text(), and the start and
+ * end are byte offsets in that line. A match is always within one line.
+ *
+ * Returns: %TRUE if there is a match.
+ *
+ * Since: 3.0.0
+ */
+gboolean gnt_text_view_get_search_match(GntTextView *view, guint *line,
+                                        gsize *start, gsize *end);
+
+/**
+ * gnt_text_view_attach_stream:
+ * @view:     The textview widget
+ * @channel:  The channel to read the text from
+ * @flags:    How to interpret the text
+ *
+ * Append all the text read from @channel to the textview, as it arrives. The
+ * channel is switched to binary, non-blocking mode. The text is added
+ * directly, so it does not need to be split or nul-terminated, and a burst of
+ * text is drawn at once.
+ *
+ * The channel is not read from while the textview is not mapped, so a writer
+ * on the other end is held up instead of filling the scrollback.
+ *
+ * When the end of the stream is reached, or on an error, the textview emits
+ * #GntTextView::stream_end and lets go of the channel. A textview reads from
+ * one stream at a time, so this detaches the previous stream.
+ *
+ * Since: 3.0.0
+ */
+void gnt_text_view_attach_stream(GntTextView *view, GIOChannel *channel, GntTextStreamFlags flags);
+
+/**
+ * gnt_text_view_attach_fd:
+ * @view:   The textview widget
+ * @fd:     The file descriptor to read the text from
+ * @flags:  How to interpret the text
+ *
+ * Like gnt_text_view_attach_stream(), for a file descriptor, for example the
+ * end of a pipe. The textview takes ownership of @fd, and closes it when the
+ * stream is detached.
+ *
+ * Since: 3.0.0
+ */
+void gnt_text_view_attach_fd(GntTextView *view, int fd, GntTextStreamFlags flags);
+
+/**
+ * gnt_text_view_detach_stream:
+ * @view:  The textview widget
+ *
+ * Stop reading from the stream attached with gnt_text_view_attach_stream() or
+ * gnt_text_view_attach_fd().
+ *
+ * Since: 3.0.0
+ */
+void gnt_text_view_detach_stream(GntTextView *view);
+
 G_END_DECLS
 
 #endif /* GNT_TEXT_VIEW_H */
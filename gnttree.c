@@ -48,6 +48,52 @@ typedef enum
 	GNT_TREE_COLUMN_RIGHT_ALIGNED = 1 << 3,
 } GntTreeColumnFlag;
 
+/* Size of the chunks of rows, unless a row needs more */
+#define TREE_CHUNK_SIZE 4096
+#define TREE_CHUNK_ALIGN (2 * sizeof(gpointer))
+#define TREE_FREE_LISTS (TREE_CHUNK_SIZE / TREE_CHUNK_ALIGN + 1)
+
+typedef struct _GntTreePool GntTreePool;
+typedef struct _GntTreeFreeSlot GntTreeFreeSlot;
+
+/* The rows are allocated from chunks, which are only ever appended to. The
+ * space of a freed row is kept for a new row of the same size. A chunk is
+ * freed once none of its rows is used anymore, or reused if it is still the
+ * one new rows go in. */
+typedef struct _GntTreeChunk
+{
+	gsize size;
+	gsize used;
+	guint live;        /* No. of rows in the chunk that are not freed yet */
+	gboolean current;  /* New rows are still added to the chunk */
+	GntTreePool *pool;
+	struct _GntTreeChunk *prev;  /* In the list of the chunks of the pool */
+	struct _GntTreeChunk *next;
+	char *data;
+} GntTreeChunk;
+
+/* The space of a freed row, in the free list for its size */
+struct _GntTreeFreeSlot
+{
+	GntTreeFreeSlot *next;
+	GntTreeFreeSlot *prev;
+	GntTreeChunk *chunk;
+	gsize size;
+};
+
+/* The chunks of a tree. Rows that are not in the tree may outlive it, so
+ * the pool is only freed along with its last chunk once the tree is gone. */
+struct _GntTreePool
+{
+	GntTreeChunk *chunk;   /* The chunk new rows are allocated from */
+	GntTreeChunk *first;   /* All the chunks */
+	guint chunks;
+	guint live;            /* No. of rows in all the chunks */
+	gboolean orphan;       /* The tree is gone */
+	gboolean dropping;     /* All the rows are being freed, with the chunks */
+	GntTreeFreeSlot *free[TREE_FREE_LISTS];  /* By size / TREE_CHUNK_ALIGN */
+};
+
 typedef struct _GntTreeColInfo
 {
 	int width;
@@ -81,7 +127,7 @@ typedef struct
 
 	GntTreeRow *root; /* The root of all evil */
 
-	GList *list;      /* List of GntTreeRow s */
+	GList *list;      /* The keys of all the rows, built when asked for */
 	GHashTable *hash; /* We need this for quickly referencing the rows */
 
 	int ncol;                /* No. of columns */
@@ -93,16 +139,52 @@ typedef struct
 	guint search_timeout;
 	int search_column;
 	gboolean (*search_func)(GntTree *tree, gpointer key, const char *search, const char *current);
+	char *search_fold;       /* The casefolded search text */
+	GPtrArray *matches;      /* The matching rows for each length of the
+	                            search text so far, see get_matches */
+	guint search_serial;     /* Changes with the search text or the rows */
+	guint matches_serial;    /* The serial the matches were marked for */
+	GPtrArray *counted;      /* The matches the search counts are for, or
+	                            NULL if they are stale, see count_matches */
+	guint counted_serial;    /* The serial they were counted for */
 
 	GCompareFunc compare;
+	GSequence *root_index;   /* The top level rows, see get_index */
+	int visible;             /* No. of rows shown when not searching */
+	GntTreeRow *count_root;  /* The counted tree of the top level rows */
 	int lastvisible;
 	int expander_level;
+	guint layout;            /* Changes when the text of every row is stale */
+
+	GntTreeVirtualFunc virtual_func;  /* See gnt_tree_set_virtual */
+	gpointer virtual_data;
+	GDestroyNotify virtual_notify;
+	guint virtual_count;
+	guint virtual_top;
+	guint virtual_current;
+	GHashTable *virtual_rows; /* The rows fetched for the screen, by index */
+
+	GntTreePool *pool;       /* The chunks rows are allocated from */
+
+	guint batch;             /* Nesting level of gnt_tree_begin_batch */
+	gboolean needs_draw;     /* A redraw was held back by the batch */
+	gboolean unsorted;       /* Some rows were added to a batch unsorted */
+	gboolean root_unsorted;  /* ... at the top level */
+	gboolean root_out_of_order;  /* The top level rows are not in order */
 } GntTreePrivate;
 
 #define	TAB_SIZE 3
 
 /* XXX: Make this one into a GObject?
  * 		 ... Probably not */
+typedef struct _GntTreeCol
+{
+	char *text;
+	gboolean isbinary;
+	gboolean isinline;  /* The text is allocated along with the row */
+	int span;       /* How many columns does it span? */
+} GntTreeCol;
+
 struct _GntTreeRow
 {
 	int box_count;
@@ -114,6 +196,8 @@ struct _GntTreeRow
 	gboolean choice;            /* Is this a choice-box?
 	                               If choice is true, then child will be NULL */
 	gboolean isselected;
+	gboolean unsorted;          /* The children need sorting after a batch */
+	gboolean out_of_order;      /* The children are not in order */
 	GntTextFormatFlags flags;
 	int color;
 
@@ -122,19 +206,48 @@ struct _GntTreeRow
 	GntTreeRow *next;
 	GntTreeRow *prev;
 
-	GList *columns;
+	GSequence *index;           /* The children, see get_index */
+	GSequenceIter *iter;        /* The position in the parent's index */
+
+	int visible;                /* No. of rows shown below this one when
+	                               it's expanded (not counting searches) */
+	int search_visible;         /* The same, counting only matching rows */
+	gboolean search_counted;    /* The row is counted as a match */
+
+	/* The siblings are also kept in a tree of their own, in the same order,
+	 * that counts the rows they show. See count_before. */
+	GntTreeRow *count_up;
+	GntTreeRow *count_left;
+	GntTreeRow *count_right;
+	GntTreeRow *count_root;     /* The counted tree of the children */
+	int count;                  /* No. of rows shown by this row and the
+	                               rows below it in the counted tree */
+	int search_count;           /* The same, counting only matching rows */
+
+	char *search_key;           /* The casefolded text of the search column */
+	int search_key_column;
+	guint match_serial;         /* The search serial the row last matched */
+
+	char *text;                 /* The text as drawn, see get_row_text */
+	int text_width;
+	guint text_layout;          /* The layout the text was made for */
+
 	GntTree *tree;
+	GntTreeChunk *chunk;        /* The chunk the row is allocated in */
+	guint size;                 /* The space of the row in the chunk */
+
+	/* The columns are allocated along with the row, followed by the text of
+	 * the columns that are not binary. */
+	int ncol;
+	GntTreeCol columns[];
 };
 
-typedef struct _GntTreeCol
-{
-	char *text;
-	gboolean isbinary;
-	int span;       /* How many columns does it span? */
-} GntTreeCol;
+#define ROW_SIZE(ncol) \
+	(G_STRUCT_OFFSET(GntTreeRow, columns) + (ncol) * sizeof(GntTreeCol))
 
 static void tree_selection_changed(GntTree *, GntTreeRow *, GntTreeRow *);
 static void _gnt_tree_init_internals(GntTree *tree, int col);
+static void free_all_rows(GntTreePrivate *priv);
 
 static guint signals[SIGS] = { 0 };
 
@@ -181,16 +294,189 @@ readjust_columns(GntTree *tree)
 	}
 }
 
-/* Move the item at position old to position new */
-static GList *
-g_list_reposition_child(GList *list, int old, int new)
+static GntTreeChunk *
+tree_chunk_new(GntTreePool *pool, gsize size)
 {
-	gpointer item = g_list_nth_data(list, old);
-	list = g_list_remove(list, item);
-	if (old < new)
-		new--;   /* because the positions would have shifted after removing the item */
-	list = g_list_insert(list, item, new);
-	return list;
+	GntTreeChunk *chunk = g_new0(GntTreeChunk, 1);
+
+	chunk->size = size;
+	chunk->data = g_malloc(size);
+	chunk->current = TRUE;
+	chunk->pool = pool;
+	chunk->next = pool->first;
+	if (pool->first)
+		pool->first->prev = chunk;
+	pool->first = chunk;
+	pool->chunks++;
+	return chunk;
+}
+
+static void
+free_slot_link(GntTreePool *pool, GntTreeFreeSlot *slot)
+{
+	GntTreeFreeSlot **list;
+
+	if (slot->size > TREE_CHUNK_SIZE)
+		return;  /* A row in a chunk of its own */
+	list = &pool->free[slot->size / TREE_CHUNK_ALIGN];
+	slot->prev = NULL;
+	slot->next = *list;
+	if (*list)
+		(*list)->prev = slot;
+	*list = slot;
+}
+
+static void
+free_slot_unlink(GntTreePool *pool, GntTreeFreeSlot *slot)
+{
+	if (slot->size > TREE_CHUNK_SIZE)
+		return;
+	if (slot->prev)
+		slot->prev->next = slot->next;
+	else
+		pool->free[slot->size / TREE_CHUNK_ALIGN] = slot->next;
+	if (slot->next)
+		slot->next->prev = slot->prev;
+}
+
+/* None of the rows in the chunk is used: take them out of the free lists. */
+static void
+tree_chunk_clear(GntTreeChunk *chunk)
+{
+	GntTreeFreeSlot *slot;
+	gsize offset;
+
+	for (offset = 0; offset < chunk->used; offset += slot->size) {
+		slot = (GntTreeFreeSlot *)(chunk->data + offset);
+		free_slot_unlink(chunk->pool, slot);
+	}
+	chunk->used = 0;
+}
+
+static void
+tree_chunk_free(GntTreeChunk *chunk)
+{
+	GntTreePool *pool = chunk->pool;
+
+	tree_chunk_clear(chunk);
+	if (chunk->prev)
+		chunk->prev->next = chunk->next;
+	else
+		pool->first = chunk->next;
+	if (chunk->next)
+		chunk->next->prev = chunk->prev;
+	g_free(chunk->data);
+	g_free(chunk);
+	if (--pool->chunks == 0 && pool->orphan)
+		g_free(pool);
+}
+
+/* None of the rows of the pool is used anymore: free all the chunks in one
+ * go, without looking at the rows in them. The current chunk is kept for
+ * the next rows, unless it holds a single large row. */
+static void
+tree_pool_reset(GntTreePool *pool)
+{
+	GntTreeChunk *chunk, *next, *keep = pool->chunk;
+
+	if (keep && keep->size > TREE_CHUNK_SIZE)
+		keep = NULL;
+	for (chunk = pool->first; chunk; chunk = next) {
+		next = chunk->next;
+		if (chunk != keep) {
+			g_free(chunk->data);
+			g_free(chunk);
+		}
+	}
+	memset(pool->free, 0, sizeof(pool->free));
+	pool->chunk = pool->first = keep;
+	pool->chunks = keep ? 1 : 0;
+	pool->live = 0;
+	if (keep) {
+		keep->prev = keep->next = NULL;
+		keep->used = 0;
+		keep->live = 0;
+	}
+}
+
+/* Allocate size bytes for a row from the free list for that size, the
+ * current chunk, or a new chunk if it is full. The memory is cleared. */
+static gpointer
+tree_chunk_alloc(GntTreePrivate *priv, gsize size, GntTreeChunk **chunk,
+                 gsize *allocated)
+{
+	GntTreePool *pool;
+	GntTreeChunk *current;
+	GntTreeFreeSlot *slot = NULL;
+	gpointer mem;
+
+	if (priv->pool == NULL)
+		priv->pool = g_new0(GntTreePool, 1);
+	pool = priv->pool;
+
+	size = (size + TREE_CHUNK_ALIGN - 1) & ~(TREE_CHUNK_ALIGN - 1);
+	if (size <= TREE_CHUNK_SIZE)
+		slot = pool->free[size / TREE_CHUNK_ALIGN];
+
+	if (slot) {
+		free_slot_unlink(pool, slot);
+		current = slot->chunk;
+		mem = slot;
+	} else {
+		current = pool->chunk;
+		if (current == NULL || current->size - current->used < size) {
+			if (current) {
+				current->current = FALSE;
+				if (current->live == 0)
+					tree_chunk_free(current);
+			}
+			current = pool->chunk =
+			        tree_chunk_new(pool, MAX(TREE_CHUNK_SIZE, size));
+		}
+		mem = current->data + current->used;
+		current->used += size;
+	}
+
+	memset(mem, 0, size);
+	current->live++;
+	pool->live++;
+	*chunk = current;
+	*allocated = size;
+	return mem;
+}
+
+/* The row at mem, of the given size, is not used anymore. */
+static void
+tree_chunk_release(GntTreeChunk *chunk, gpointer mem, gsize size)
+{
+	GntTreeFreeSlot *slot = mem;
+
+	chunk->pool->live--;
+	slot->chunk = chunk;
+	slot->size = size;
+	free_slot_link(chunk->pool, slot);
+
+	if (--chunk->live > 0)
+		return;
+	if (chunk->current)
+		tree_chunk_clear(chunk); /* Start over */
+	else
+		tree_chunk_free(chunk);
+}
+
+/* The rows were added, removed or moved, so the list of rows is stale. */
+static void
+rows_changed(GntTreePrivate *priv)
+{
+	g_list_free(priv->list);
+	priv->list = NULL;
+}
+
+static void
+row_text_changed(GntTreeRow *row)
+{
+	g_free(row->text);
+	row->text = NULL;
 }
 
 static GntTreeRow *
@@ -206,32 +492,117 @@ _get_next(GntTreeRow *row, gboolean godeep)
 }
 
 static gboolean
-row_matches_search(GntTreeRow *row)
+match_row(GntTreePrivate *priv, GntTreeRow *row)
 {
-	GntTree *tree = row->tree;
-	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+	GntTreeCol *col;
 
-	if (SEARCHING(priv)) {
-		GntTreeCol *col;
-		char *one, *two, *z;
+	if (row->ncol == 0)
+		return FALSE;
+	if (priv->search_column < row->ncol)
+		col = &row->columns[priv->search_column];
+	else
+		col = &row->columns[0];
 
-		col = g_list_nth_data(row->columns, priv->search_column);
-		if (!col) {
-			col = row->columns->data;
-		}
+	if (priv->search_func) {
+		return priv->search_func(row->tree, row->key,
+		                         priv->search->str, col->text);
+	}
+
+	if (row->search_key == NULL ||
+	    row->search_key_column != priv->search_column) {
+		g_free(row->search_key);
+		row->search_key = g_utf8_casefold(col->text, -1);
+		row->search_key_column = priv->search_column;
+	}
+	return strstr(row->search_key, priv->search_fold) != NULL;
+}
 
-		if (priv->search_func) {
-			return priv->search_func(tree, row->key,
-			                         priv->search->str, col->text);
+static void
+free_matches(gpointer data)
+{
+	if (data)
+		g_ptr_array_unref(data);
+}
+
+/* Returns the rows matching the search text, and marks them with the search
+ * serial. The matches for each length of the search text are kept, so typing
+ * another character only has to look through the rows that matched so far,
+ * and a backspace goes back to the matches before it. */
+static GPtrArray *
+get_matches(GntTreePrivate *priv)
+{
+	GPtrArray *matches, *prev = NULL;
+	GntTreeRow *row;
+	guint len = priv->search->len, i;
+
+	if (priv->matches == NULL)
+		priv->matches = g_ptr_array_new_with_free_func(free_matches);
+
+	if (priv->matches->len == len &&
+	    (matches = g_ptr_array_index(priv->matches, len - 1)) != NULL) {
+		if (priv->matches_serial == priv->search_serial)
+			return matches;
+	} else {
+		/* A custom search function might match more with more text */
+		if (len > 1 && priv->matches->len == len - 1 &&
+		    priv->search_func == NULL)
+			prev = g_ptr_array_index(priv->matches, len - 2);
+
+		matches = g_ptr_array_new();
+		if (prev) {
+			for (i = 0; i < prev->len; i++) {
+				row = g_ptr_array_index(prev, i);
+				if (match_row(priv, row))
+					g_ptr_array_add(matches, row);
+			}
+		} else {
+			for (row = priv->root; row; row = _get_next(row, TRUE)) {
+				if (match_row(priv, row))
+					g_ptr_array_add(matches, row);
+			}
 		}
+		g_ptr_array_set_size(priv->matches, len - 1);
+		g_ptr_array_add(priv->matches, matches);
+	}
 
-		one = g_utf8_casefold(col->text, -1);
-		two = g_utf8_casefold(priv->search->str, -1);
-		z = strstr(one, two);
-		g_free(one);
-		g_free(two);
-		if (z == NULL)
-			return FALSE;
+	for (i = 0; i < matches->len; i++) {
+		row = g_ptr_array_index(matches, i);
+		row->match_serial = priv->search_serial;
+	}
+	priv->matches_serial = priv->search_serial;
+	return matches;
+}
+
+/* The search text changed, so the matches for any longer text are stale. */
+static void
+search_text_changed(GntTreePrivate *priv)
+{
+	g_free(priv->search_fold);
+	priv->search_fold = g_utf8_casefold(priv->search->str, -1);
+	priv->search_serial++;
+	if (priv->matches && priv->matches->len > priv->search->len)
+		g_ptr_array_set_size(priv->matches, priv->search->len);
+}
+
+/* Rows were added, removed or changed, so all the matches are stale. */
+static void
+search_rows_changed(GntTreePrivate *priv)
+{
+	priv->search_serial++;
+	if (priv->matches)
+		g_ptr_array_set_size(priv->matches, 0);
+	g_clear_pointer(&priv->counted, g_ptr_array_unref);
+}
+
+static gboolean
+row_matches_search(GntTreeRow *row)
+{
+	GntTree *tree = row->tree;
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+
+	if (SEARCHING(priv)) {
+		get_matches(priv);
+		return row->match_serial == priv->search_serial;
 	}
 	return TRUE;
 }
@@ -322,14 +693,325 @@ get_prev_n(GntTreeRow *row, int n)
 	return row;
 }
 
+/* The number of rows a row takes up with its children. */
+static int
+row_height(GntTreeRow *row)
+{
+	return 1 + (row->collapsed ? 0 : row->visible);
+}
+
+/* The number of matching rows a row takes up with its children. */
+static int
+row_search_height(GntTreeRow *row)
+{
+	return (row->search_counted ? 1 : 0) +
+	       (row->collapsed ? 0 : row->search_visible);
+}
+
+/* Each group of siblings is also kept in a treap, ordered like the siblings,
+ * where each row counts the rows shown by itself and the rows below it in the
+ * treap, with their children. The rows shown before a row among its siblings
+ * are counted by going up the treap, so finding the position of a row on the
+ * screen takes a time that grows with the log of the number of rows. */
+static GntTreeRow **
+count_root(GntTreePrivate *priv, GntTreeRow *parent)
+{
+	return parent ? &parent->count_root : &priv->count_root;
+}
+
+/* The treap is balanced by a random looking priority for each row. */
+static guint
+count_priority(GntTreeRow *row)
+{
+	guint64 h = GPOINTER_TO_SIZE(row);
+
+	h ^= h >> 33;
+	h *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+	h ^= h >> 33;
+	return (guint)h;
+}
+
+/* Rotate row up over its parent in the treap. */
+static void
+count_rotate(GntTreePrivate *priv, GntTreeRow *row)
+{
+	GntTreeRow *up = row->count_up, *moved;
+	int count = up->count, search_count = up->search_count;
+
+	/* The counts of the parent, without its children in the treap */
+	up->count -= (up->count_left ? up->count_left->count : 0) +
+	             (up->count_right ? up->count_right->count : 0);
+	up->search_count -=
+	        (up->count_left ? up->count_left->search_count : 0) +
+	        (up->count_right ? up->count_right->search_count : 0);
+
+	if (up->count_left == row) {
+		moved = row->count_right;
+		up->count_left = moved;
+		row->count_right = up;
+	} else {
+		moved = row->count_left;
+		up->count_right = moved;
+		row->count_left = up;
+	}
+	if (moved)
+		moved->count_up = up;
+
+	row->count_up = up->count_up;
+	if (row->count_up == NULL)
+		*count_root(priv, row->parent) = row;
+	else if (row->count_up->count_left == up)
+		row->count_up->count_left = row;
+	else
+		row->count_up->count_right = row;
+	up->count_up = row;
+
+	up->count += (up->count_left ? up->count_left->count : 0) +
+	             (up->count_right ? up->count_right->count : 0);
+	up->search_count +=
+	        (up->count_left ? up->count_left->search_count : 0) +
+	        (up->count_right ? up->count_right->search_count : 0);
+	row->count = count;
+	row->search_count = search_count;
+}
+
+/* Add to the counts of the row and the rows above it in the treap. */
+static void
+count_add(GntTreeRow *row, int delta, int search_delta)
+{
+	for (; row; row = row->count_up) {
+		row->count += delta;
+		row->search_count += search_delta;
+	}
+}
+
+/* Put a row that was just linked to its siblings in their treap, with the
+ * counts it has. The siblings before it must be in the treap already. */
+static void
+count_insert(GntTreePrivate *priv, GntTreeRow *row)
+{
+	GntTreeRow **root = count_root(priv, row->parent);
+	GntTreeRow *next;
+
+	if (row->prev && row->prev->count_right == NULL) {
+		row->prev->count_right = row;
+		row->count_up = row->prev;
+	} else {
+		/* Go before the row that comes after the previous one */
+		next = row->prev ? row->prev->count_right : *root;
+		if (next) {
+			while (next->count_left)
+				next = next->count_left;
+			next->count_left = row;
+		} else {
+			*root = row;
+		}
+		row->count_up = next;
+	}
+	count_add(row->count_up, row->count, row->search_count);
+
+	while (row->count_up &&
+	       count_priority(row) > count_priority(row->count_up))
+		count_rotate(priv, row);
+}
+
+/* Take a row out of the treap of its siblings. It keeps its own counts. */
+static void
+count_remove(GntTreePrivate *priv, GntTreeRow *row)
+{
+	GntTreeRow *up;
+
+	while (row->count_left || row->count_right) {
+		GntTreeRow *child = row->count_left;
+		if (child == NULL || (row->count_right &&
+		                      count_priority(row->count_right) >
+		                              count_priority(child)))
+			child = row->count_right;
+		count_rotate(priv, child);
+	}
+
+	up = row->count_up;
+	count_add(up, -row->count, -row->search_count);
+	if (up == NULL)
+		*count_root(priv, row->parent) = NULL;
+	else if (up->count_left == row)
+		up->count_left = NULL;
+	else
+		up->count_right = NULL;
+	row->count_up = NULL;
+}
+
+/* Make the treap of a group of siblings over, after they were reordered. */
+static void
+count_rebuild(GntTreePrivate *priv, GntTreeRow *parent)
+{
+	GntTreeRow *row;
+
+	*count_root(priv, parent) = NULL;
+	for (row = parent ? parent->child : priv->root; row; row = row->next) {
+		row->count_up = row->count_left = row->count_right = NULL;
+		row->count = row_height(row);
+		row->search_count = row_search_height(row);
+		count_insert(priv, row);
+	}
+}
+
+/* The number of rows shown before a row among its siblings and their
+ * children. */
+static int
+count_before(GntTreeRow *row, gboolean search)
+{
+	GntTreeRow *left = row->count_left;
+	int count = left ? (search ? left->search_count : left->count) : 0;
+
+	for (; row->count_up; row = row->count_up) {
+		if (row->count_up->count_right == row)
+			count += search ? row->count_up->search_count - row->search_count
+			                : row->count_up->count - row->count;
+	}
+	return count;
+}
+
+/* The number of matching rows a row changed by, so update the search counts
+ * of its parents up to the first collapsed one. */
+static void
+search_height_changed(GntTreeRow *row, int delta)
+{
+	for (; row; row = row->parent) {
+		count_add(row, 0, delta);
+		if (row->parent == NULL)
+			return;
+		row->parent->search_visible += delta;
+		if (row->parent->collapsed)
+			return;
+	}
+}
+
+/* Count the matching rows in a treap of siblings and all the rows below
+ * them, from scratch. */
+static int
+count_all_matches(GntTreePrivate *priv, GntTreeRow *row)
+{
+	if (row == NULL)
+		return 0;
+	row->search_counted = row->match_serial == priv->search_serial;
+	row->search_visible = count_all_matches(priv, row->count_root);
+	row->search_count = row_search_height(row) +
+	                    count_all_matches(priv, row->count_left) +
+	                    count_all_matches(priv, row->count_right);
+	return row->search_count;
+}
+
+/* Bring the search counts up to date with the matches. When only the search
+ * text changed, only the rows that started or stopped matching are counted
+ * again. When rows were added, removed or changed, every row is. */
+static void
+count_matches(GntTreePrivate *priv)
+{
+	GPtrArray *matches = get_matches(priv);
+	GntTreeRow *row;
+	guint i;
+
+	if (priv->counted && priv->counted_serial == priv->search_serial)
+		return;
+
+	if (priv->counted == NULL) {
+		count_all_matches(priv, priv->count_root);
+	} else {
+		for (i = 0; i < priv->counted->len; i++) {
+			row = g_ptr_array_index(priv->counted, i);
+			if (row->search_counted &&
+			    row->match_serial != priv->search_serial) {
+				row->search_counted = FALSE;
+				search_height_changed(row, -1);
+			}
+		}
+		for (i = 0; i < matches->len; i++) {
+			row = g_ptr_array_index(matches, i);
+			if (!row->search_counted) {
+				row->search_counted = TRUE;
+				search_height_changed(row, 1);
+			}
+		}
+		g_ptr_array_unref(priv->counted);
+	}
+	priv->counted = g_ptr_array_ref(matches);
+	priv->counted_serial = priv->search_serial;
+}
+
+/* The number of matching rows that aren't in collapsed rows. */
+static int
+get_search_visible(GntTreePrivate *priv)
+{
+	count_matches(priv);
+	return priv->count_root ? priv->count_root->search_count : 0;
+}
+
+/* The height of row changed by delta (or it was added or removed), so update
+ * the counts of its parents up to the first collapsed one. */
+static void
+row_height_changed(GntTreePrivate *priv, GntTreeRow *row, int delta)
+{
+	for (;;) {
+		count_add(row, delta, 0);
+		row = row->parent;
+		if (row == NULL) {
+			priv->visible += delta;
+			return;
+		}
+		row->visible += delta;
+		if (row->collapsed)
+			return;
+	}
+}
+
+static void
+set_collapsed(GntTreePrivate *priv, GntTreeRow *row, gboolean collapsed)
+{
+	if (row->collapsed == collapsed)
+		return;
+	row->collapsed = collapsed;
+	row_text_changed(row);
+	row_height_changed(priv, row, collapsed ? -row->visible : row->visible);
+	if (priv->counted) {
+		search_height_changed(row, collapsed ? -row->search_visible
+		                                     : row->search_visible);
+	}
+}
+
 /* Distance of row from the root */
-/* XXX: This is uber-inefficient */
 static int
 get_root_distance(GntTreeRow *row)
 {
+	GntTreePrivate *priv;
+	gboolean search;
+	int dist = 0;
+
 	if (row == NULL)
 		return -1;
-	return get_root_distance(get_prev(row)) + 1;
+
+	priv = gnt_tree_get_instance_private(row->tree);
+	search = SEARCHING(priv);
+	if (search)
+		count_matches(priv);
+
+	for (; row; row = row->parent) {
+		dist += count_before(row, search);
+		if (row->parent && (!search || row->parent->search_counted))
+			dist++;
+	}
+	return dist;
+}
+
+/* Whether the row is under a collapsed row. */
+static gboolean
+row_is_hidden(GntTreeRow *row)
+{
+	for (row = row->parent; row; row = row->parent) {
+		if (row->collapsed)
+			return TRUE;
+	}
+	return FALSE;
 }
 
 /* Returns the distance between a and b.
@@ -337,10 +1019,6 @@ get_root_distance(GntTreeRow *row)
 static int
 get_distance(GntTreeRow *a, GntTreeRow *b)
 {
-	/* First get the distance from a to the root.
-	 * Then the distance from b to the root.
-	 * Subtract.
-	 * It's not that good, but it works. */
 	int ha = get_root_distance(a);
 	int hb = get_root_distance(b);
 
@@ -365,13 +1043,11 @@ static char *
 update_row_text(GntTreePrivate *priv, GntTreeRow *row)
 {
 	GString *string = g_string_new(NULL);
-	GList *iter;
 	int i;
 	gboolean notfirst = FALSE;
 
-	for (i = 0, iter = row->columns; i < priv->ncol && iter;
-	     i++, iter = iter->next) {
-		GntTreeCol *col = iter->data;
+	for (i = 0; i < priv->ncol && i < row->ncol; i++) {
+		GntTreeCol *col = &row->columns[i];
 		const char *text;
 		int len;
 		int fl = 0;
@@ -444,13 +1120,34 @@ update_row_text(GntTreePrivate *priv, GntTreeRow *row)
 		}
 
 		if (!RIGHT_ALIGNED(priv, i) && len < priv->columns[i].width &&
-		    iter->next) {
+		    i + 1 < row->ncol) {
 			g_string_append_printf(string, "%*s", width - len, "");
 		}
 	}
 	return g_string_free(string, FALSE);
 }
 
+/* The text of the rows is only made when they are drawn, and kept until the
+ * row or the layout of the tree changes. */
+static const char *
+get_row_text(GntTreePrivate *priv, GntTreeRow *row, int *width)
+{
+	if (row->text == NULL || row->text_layout != priv->layout) {
+		g_free(row->text);
+		row->text = update_row_text(priv, row);
+		row->text_width = gnt_util_onscreen_width(row->text, NULL);
+		row->text_layout = priv->layout;
+	}
+	*width = row->text_width;
+	return row->text;
+}
+
+static void
+layout_changed(GntTreePrivate *priv)
+{
+	priv->layout++;
+}
+
 #define NEXT_X x += priv->columns[i].width + (i > 0 ? 1 : 0)
 
 static void
@@ -473,6 +1170,232 @@ tree_mark_columns(GntTree *tree, int pos, int y, chtype type)
 	}
 }
 
+/* In virtual mode, the application gives the rows by their index when they
+ * are drawn, and only the rows on the screen are kept. */
+static int
+virtual_lines(GntTree *tree)
+{
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+	GntWidget *widget = GNT_WIDGET(tree);
+	gint height;
+
+	gnt_widget_get_internal_size(widget, NULL, &height);
+	height -= priv->show_title * 2 +
+	          (gnt_widget_get_has_border(widget) ? 2 : 0);
+	return MAX(height, 1);
+}
+
+static GntTreeRow *
+virtual_get_row(GntTree *tree, guint index)
+{
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+	GntTreeRow *row;
+	gpointer key = NULL;
+
+	row = g_hash_table_lookup(priv->virtual_rows, GUINT_TO_POINTER(index));
+	if (row)
+		return row;
+
+	row = priv->virtual_func(tree, index, &key, priv->virtual_data);
+	if (row == NULL) {
+		gnt_warning("No row for index %u", index);
+		row = gnt_tree_create_row_from_list(tree, NULL);
+	}
+	row->tree = tree;
+	row->key = key;
+	g_hash_table_insert(priv->virtual_rows, GUINT_TO_POINTER(index), row);
+	return row;
+}
+
+static gboolean
+virtual_row_hidden(gpointer index, G_GNUC_UNUSED gpointer row, gpointer data)
+{
+	GntTree *tree = data;
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+	guint i = GPOINTER_TO_UINT(index);
+
+	return i < priv->virtual_top ||
+	       i - priv->virtual_top >= (guint)virtual_lines(tree);
+}
+
+/* Forget the rows that scrolled off the screen. */
+static void
+virtual_trim(GntTree *tree)
+{
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+
+	g_hash_table_foreach_remove(priv->virtual_rows, virtual_row_hidden, tree);
+}
+
+/* Keep the selection in range and on the screen. Returns the top row. */
+static guint
+virtual_scroll(GntTree *tree)
+{
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+	guint lines = virtual_lines(tree);
+
+	if (priv->virtual_count == 0) {
+		priv->virtual_current = priv->virtual_top = 0;
+		return 0;
+	}
+	if (priv->virtual_current >= priv->virtual_count)
+		priv->virtual_current = priv->virtual_count - 1;
+	if (priv->virtual_current < priv->virtual_top)
+		priv->virtual_top = priv->virtual_current;
+	else if (priv->virtual_current - priv->virtual_top >= lines)
+		priv->virtual_top = priv->virtual_current - lines + 1;
+	if (priv->virtual_count - priv->virtual_top < lines)
+		priv->virtual_top = priv->virtual_count > lines
+		                            ? priv->virtual_count - lines
+		                            : 0;
+	return priv->virtual_top;
+}
+
+static gpointer
+virtual_selection_key(GntTree *tree)
+{
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+
+	if (priv->virtual_count == 0)
+		return NULL;
+	return virtual_get_row(tree, priv->virtual_current)->key;
+}
+
+static void
+draw_row(GntTree *tree, GntTreeRow *row, int y, int pos, int scrcol,
+         gboolean selected)
+{
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+	GntWidget *widget = GNT_WIDGET(tree);
+	WINDOW *window = gnt_widget_get_window(widget);
+	GntTextFormatFlags flags = row->flags;
+	const char *str, *end = NULL;
+	int wr;
+	int attr = 0;
+
+	str = get_row_text(priv, row, &wr);
+
+	/* The text that doesn't fit is left out without copying the rest, unless
+	 * it has to be converted to the locale anyway */
+	if (wr > scrcol)
+		end = gnt_util_onscreen_width_to_pointer(str, scrcol, &wr);
+
+	if (flags & GNT_TEXT_FLAG_BOLD)
+		attr |= A_BOLD;
+	if (flags & GNT_TEXT_FLAG_UNDERLINE)
+		attr |= A_UNDERLINE;
+	if (flags & GNT_TEXT_FLAG_BLINK)
+		attr |= A_BLINK;
+
+	if (selected) {
+		attr |= A_BOLD;
+		if (gnt_widget_has_focus(widget))
+			attr |= gnt_color_pair(GNT_COLOR_HIGHLIGHT);
+		else
+			attr |= gnt_color_pair(GNT_COLOR_HIGHLIGHT_D);
+	} else {
+		if (flags & GNT_TEXT_FLAG_DIM)
+			if (row->color)
+				attr |= (A_DIM | gnt_color_pair(row->color));
+			else
+				attr |= (A_DIM | gnt_color_pair(GNT_COLOR_DISABLED));
+		else if (flags & GNT_TEXT_FLAG_HIGHLIGHT)
+			attr |= (A_DIM | gnt_color_pair(GNT_COLOR_HIGHLIGHT));
+		else if (row->color)
+			attr |= gnt_color_pair(row->color);
+		else
+			attr |= gnt_color_pair(GNT_COLOR_NORMAL);
+	}
+
+	wbkgdset(window, '\0' | attr);
+	if (end == NULL) {
+		mvwaddstr(window, y, pos, C_(str));
+	} else if (gnt_need_conversation_to_locale) {
+		char *cut = g_strndup(str, end - str);
+		mvwaddstr(window, y, pos, C_(cut));
+		g_free(cut);
+	} else {
+		mvwaddnstr(window, y, pos, str, end - str);
+	}
+	whline(window, ' ', scrcol - wr);
+	tree_mark_columns(tree, pos, y,
+	                  (priv->show_separator ? ACS_VLINE : ' ') | attr);
+}
+
+/* Clear the lines from y to the bottom of the tree. */
+static void
+clear_rows(GntTree *tree, int y, int pos)
+{
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+	GntWidget *widget = GNT_WIDGET(tree);
+	WINDOW *window = gnt_widget_get_window(widget);
+	gint width, height;
+
+	gnt_widget_get_internal_size(widget, &width, &height);
+	wbkgdset(window, '\0' | gnt_color_pair(GNT_COLOR_NORMAL));
+	while (y < height - pos) {
+		mvwhline(window, y, pos, ' ', width - pos * 2 - 1);
+		tree_mark_columns(tree, pos, y,
+		                  (priv->show_separator ? ACS_VLINE : ' '));
+		y++;
+	}
+}
+
+/* total is the number of rows after the first one, and up the number of rows
+ * above the top one. above and below say whether there are more rows to
+ * scroll to. */
+static void
+draw_scrollbar(GntTree *tree, int pos, int start, int rows, gint64 total,
+               gint64 up, gboolean above, gboolean below)
+{
+	GntWidget *widget = GNT_WIDGET(tree);
+	WINDOW *window = gnt_widget_get_window(widget);
+	gint width, height;
+	int scrcol;
+
+	gnt_widget_get_internal_size(widget, &width, &height);
+	scrcol = width - pos - 1; /* position of the scrollbar */
+	rows--;
+	if (rows > 0)
+	{
+		gint64 down;
+		int showing, position;
+
+		showing = rows * rows / MAX(total, 1) + 1;
+		showing = MIN(rows, showing);
+
+		total -= rows;
+		down = total - up;
+
+		position = (rows - showing) * up / MAX(1, up + down);
+		position = MAX(above, position);
+
+		if (showing + position > rows)
+			position = rows - showing;
+
+		if (showing + position == rows  && below)
+			position = MAX(0, rows - 1 - showing);
+		else if (showing + position < rows && !below)
+			position = rows - showing;
+
+		position += pos + start + 1;
+
+		mvwvline(window, pos + start + 1, scrcol,
+		         ' ' | gnt_color_pair(GNT_COLOR_NORMAL), rows);
+		mvwvline(window, position, scrcol,
+		         ACS_CKBOARD | gnt_color_pair(GNT_COLOR_HIGHLIGHT_D),
+		         showing);
+	}
+
+	mvwaddch(window, start + pos, scrcol,
+	         (above ? ACS_UARROW : ' ') |
+	                 gnt_color_pair(GNT_COLOR_HIGHLIGHT_D));
+
+	mvwaddch(window, height - pos - 1, scrcol,
+	         (below ? ACS_DARROW : ' ') |
+	                 gnt_color_pair(GNT_COLOR_HIGHLIGHT_D));
+}
+
 static void
 redraw_tree(GntTree *tree)
 {
@@ -489,6 +1412,11 @@ redraw_tree(GntTree *tree)
 	if (!gnt_widget_get_mapped(GNT_WIDGET(tree)))
 		return;
 
+	if (priv->batch) {
+		priv->needs_draw = TRUE;
+		return;
+	}
+
 	gnt_widget_get_internal_size(widget, &width, &height);
 	pos = gnt_widget_get_has_border(widget) ? 1 : 0;
 
@@ -545,152 +1473,129 @@ redraw_tree(GntTree *tree)
 	}
 
 	rows = height - pos * 2 - start - 1;
-	priv->bottom = get_next_n_opt(priv->top, rows, &down);
-	if (down < rows)
-	{
-		priv->top = get_prev_n(priv->bottom, rows);
-		if (priv->top == NULL) {
-			priv->top = priv->root;
-		}
-	}
-
-	up = get_distance(priv->top, priv->current);
-	if (up < 0)
-		priv->top = priv->current;
-	else if (up >= height - pos)
-		priv->top = get_prev_n(priv->current, rows);
-
-	if (priv->top && !row_matches_search(priv->top)) {
-		priv->top = get_next(priv->top);
-	}
-	row = priv->top;
 	/* exclude the borders and the scrollbar */
 	scrcol = width - 1 - 2 * pos;
 
-	if (priv->current && !row_matches_search(priv->current)) {
-		GntTreeRow *old = priv->current;
-		priv->current = priv->top;
-		tree_selection_changed(tree, old, priv->current);
-	}
+	if (priv->virtual_func) {
+		guint index = virtual_scroll(tree);
 
-	for (i = start + pos; row && i < height - pos;
-	     i++, row = get_next(row)) {
-		char *str;
-		int wr;
+		for (i = start + pos; index < priv->virtual_count && i < height - pos;
+		     i++, index++) {
+			if (index == priv->virtual_current)
+				current = i;
+			draw_row(tree, virtual_get_row(tree, index), i, pos, scrcol,
+			         index == priv->virtual_current);
+		}
+		virtual_trim(tree);
+		clear_rows(tree, i, pos);
+		draw_scrollbar(tree, pos, start, rows,
+		               (gint64)priv->virtual_count - 1, priv->virtual_top,
+		               priv->virtual_top > 0,
+		               index < priv->virtual_count);
+	} else {
+		priv->bottom = get_next_n_opt(priv->top, rows, &down);
+		if (down < rows)
+		{
+			priv->top = get_prev_n(priv->bottom, rows);
+			if (priv->top == NULL) {
+				priv->top = priv->root;
+			}
+		}
 
-		GntTextFormatFlags flags = row->flags;
-		int attr = 0;
+		up = get_distance(priv->top, priv->current);
+		if (up < 0)
+			priv->top = priv->current;
+		else if (up >= height - pos)
+			priv->top = get_prev_n(priv->current, rows);
 
-		if (!row_matches_search(row))
-			continue;
-		str = update_row_text(priv, row);
+		if (priv->top && !row_matches_search(priv->top)) {
+			priv->top = get_next(priv->top);
+		}
+		row = priv->top;
 
-		if ((wr = gnt_util_onscreen_width(str, NULL)) > scrcol)
-		{
-			char *s = (char*)gnt_util_onscreen_width_to_pointer(str, scrcol, &wr);
-			*s = '\0';
+		if (priv->current && !row_matches_search(priv->current)) {
+			GntTreeRow *old = priv->current;
+			priv->current = priv->top;
+			tree_selection_changed(tree, old, priv->current);
 		}
 
-		if (flags & GNT_TEXT_FLAG_BOLD)
-			attr |= A_BOLD;
-		if (flags & GNT_TEXT_FLAG_UNDERLINE)
-			attr |= A_UNDERLINE;
-		if (flags & GNT_TEXT_FLAG_BLINK)
-			attr |= A_BLINK;
-
-		if (row == priv->current) {
-			current = i;
-			attr |= A_BOLD;
-			if (gnt_widget_has_focus(widget))
-				attr |= gnt_color_pair(GNT_COLOR_HIGHLIGHT);
-			else
-				attr |= gnt_color_pair(GNT_COLOR_HIGHLIGHT_D);
-		} else {
-			if (flags & GNT_TEXT_FLAG_DIM)
-				if (row->color)
-					attr |= (A_DIM | gnt_color_pair(row->color));
-				else
-					attr |= (A_DIM | gnt_color_pair(GNT_COLOR_DISABLED));
-			else if (flags & GNT_TEXT_FLAG_HIGHLIGHT)
-				attr |= (A_DIM | gnt_color_pair(GNT_COLOR_HIGHLIGHT));
-			else if (row->color)
-				attr |= gnt_color_pair(row->color);
-			else
-				attr |= gnt_color_pair(GNT_COLOR_NORMAL);
+		for (i = start + pos; row && i < height - pos;
+		     i++, row = get_next(row)) {
+			if (!row_matches_search(row))
+				continue;
+			if (row == priv->current)
+				current = i;
+			draw_row(tree, row, i, pos, scrcol, row == priv->current);
+			priv->bottom = row;
 		}
 
-		wbkgdset(window, '\0' | attr);
-		mvwaddstr(window, i, pos, C_(str));
-		whline(window, ' ', scrcol - wr);
-		priv->bottom = row;
-		g_free(str);
-		tree_mark_columns(tree, pos, i,
-		                  (priv->show_separator ? ACS_VLINE : ' ') |
-		                          attr);
+		clear_rows(tree, i, pos);
+		draw_scrollbar(tree, pos, start, rows,
+		               (SEARCHING(priv) ? get_search_visible(priv)
+		                                : priv->visible) - 1,
+		               get_distance(priv->root, priv->top),
+		               priv->top != priv->root, row != NULL);
 	}
 
-	wbkgdset(window, '\0' | gnt_color_pair(GNT_COLOR_NORMAL));
-	while (i < height - pos) {
-		mvwhline(window, i, pos, ' ', width - pos * 2 - 1);
-		tree_mark_columns(tree, pos, i,
-		                  (priv->show_separator ? ACS_VLINE : ' '));
-		i++;
+	/* If there's a search-text, show it in the bottom of the tree */
+	if (SEARCHING(priv)) {
+		const char *str;
+		scrcol = width - pos - 1; /* position of the scrollbar */
+		str = gnt_util_onscreen_width_to_pointer(
+		        priv->search->str, scrcol - 1, NULL);
+		wbkgdset(window, '\0' | gnt_color_pair(GNT_COLOR_HIGHLIGHT_D));
+		mvwaddnstr(window, height - pos - 1, pos, priv->search->str,
+		           str - priv->search->str);
 	}
+	wmove(window, current, pos);
 
-	scrcol = width - pos - 1; /* position of the scrollbar */
-	rows--;
-	if (rows > 0)
-	{
-		int total = 0;
-		int showing, position;
-
-		get_next_n_opt(priv->root, g_list_length(priv->list), &total);
-		showing = rows * rows / MAX(total, 1) + 1;
-		showing = MIN(rows, showing);
-
-		total -= rows;
-		up = get_distance(priv->root, priv->top);
-		down = total - up;
-
-		position = (rows - showing) * up / MAX(1, up + down);
-		position = MAX((priv->top != priv->root), position);
+	gnt_widget_queue_update(widget);
+}
 
-		if (showing + position > rows)
-			position = rows - showing;
+/* Draw a row again after it changed. Nothing else in the tree moves, so only
+ * that row is damaged. */
+static void
+redraw_row(GntTree *tree, GntTreeRow *row)
+{
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+	GntWidget *widget = GNT_WIDGET(tree);
+	WINDOW *window = gnt_widget_get_window(widget);
+	gint width, height;
+	int pos, y, curx, cury;
 
-		if (showing + position == rows  && row)
-			position = MAX(0, rows - 1 - showing);
-		else if (showing + position < rows && !row)
-			position = rows - showing;
+	if (!gnt_widget_get_mapped(widget))
+		return;
 
-		position += pos + start + 1;
+	if (priv->batch) {
+		priv->needs_draw = TRUE;
+		return;
+	}
 
-		mvwvline(window, pos + start + 1, scrcol,
-		         ' ' | gnt_color_pair(GNT_COLOR_NORMAL), rows);
-		mvwvline(window, position, scrcol,
-		         ACS_CKBOARD | gnt_color_pair(GNT_COLOR_HIGHLIGHT_D),
-		         showing);
+	/* The distances only agree with the screen when the rows at the top and
+	 * bottom are not under a collapsed row */
+	if (priv->virtual_func || SEARCHING(priv) || priv->top == NULL ||
+	    priv->bottom == NULL || row_is_hidden(priv->top) ||
+	    row_is_hidden(priv->bottom)) {
+		redraw_tree(tree);
+		return;
 	}
 
-	mvwaddch(window, start + pos, scrcol,
-	         ((priv->top != priv->root) ? ACS_UARROW : ' ') |
-	                 gnt_color_pair(GNT_COLOR_HIGHLIGHT_D));
+	if (row_is_hidden(row))
+		return;
 
-	mvwaddch(window, height - pos - 1, scrcol,
-	         (row ? ACS_DARROW : ' ') |
-	                 gnt_color_pair(GNT_COLOR_HIGHLIGHT_D));
+	y = get_distance(priv->top, row);
+	if (y < 0 || get_distance(row, priv->bottom) < 0)
+		return;
 
-	/* If there's a search-text, show it in the bottom of the tree */
-	if (SEARCHING(priv)) {
-		const char *str = gnt_util_onscreen_width_to_pointer(
-		        priv->search->str, scrcol - 1, NULL);
-		wbkgdset(window, '\0' | gnt_color_pair(GNT_COLOR_HIGHLIGHT_D));
-		mvwaddnstr(window, height - pos - 1, pos, priv->search->str,
-		           str - priv->search->str);
-	}
-	wmove(window, current, pos);
+	gnt_widget_get_internal_size(widget, &width, &height);
+	pos = gnt_widget_get_has_border(widget) ? 1 : 0;
+	y += pos + (priv->show_title ? 2 : 0);
 
-	gnt_widget_queue_update(widget);
+	getyx(window, cury, curx);
+	draw_row(tree, row, y, pos, width - 1 - 2 * pos, row == priv->current);
+	wmove(window, cury, curx);
+
+	gnt_widget_queue_update_area(widget, 0, y, width, 1);
 }
 
 static void
@@ -752,6 +1657,36 @@ tree_selection_changed(GntTree *tree, GntTreeRow *old, GntTreeRow *current)
 				current ? current->key : NULL);
 }
 
+/* Move the top and the selection of a virtual tree, keeping both in range. */
+static gboolean
+virtual_select(GntTree *tree, gint64 top, gint64 current)
+{
+	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
+	gint64 last = (gint64)priv->virtual_count - 1;
+	guint old = priv->virtual_current;
+	gpointer oldkey;
+
+	if (last < 0)
+		return FALSE;
+
+	top = CLAMP(top, 0, MAX(last - virtual_lines(tree) + 1, 0));
+	current = CLAMP(current, 0, last);
+	if (top == priv->virtual_top && current == priv->virtual_current)
+		return FALSE;
+
+	oldkey = virtual_selection_key(tree);
+	priv->virtual_top = top;
+	priv->virtual_current = current;
+	virtual_scroll(tree);
+	redraw_tree(tree);
+	virtual_trim(tree);
+	if (old != priv->virtual_current) {
+		g_signal_emit(tree, signals[SIG_SELECTION_CHANGED], 0, oldkey,
+		              virtual_selection_key(tree));
+	}
+	return TRUE;
+}
+
 static gboolean
 action_down(GntBindable *bind, G_GNUC_UNUSED GList *unused)
 {
@@ -759,7 +1694,13 @@ action_down(GntBindable *bind, G_GNUC_UNUSED GList *unused)
 	GntTree *tree = GNT_TREE(bind);
 	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
 	GntTreeRow *old = priv->current;
-	GntTreeRow *row = get_next(priv->current);
+	GntTreeRow *row;
+
+	if (priv->virtual_func)
+		return virtual_select(tree, priv->virtual_top,
+		                      (gint64)priv->virtual_current + 1);
+
+	row = get_next(priv->current);
 	if (row == NULL)
 		return FALSE;
 	priv->current = row;
@@ -803,7 +1744,13 @@ action_up(GntBindable *bind, G_GNUC_UNUSED GList *params)
 	GntTree *tree = GNT_TREE(bind);
 	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
 	GntTreeRow *old = priv->current;
-	GntTreeRow *row = get_prev(priv->current);
+	GntTreeRow *row;
+
+	if (priv->virtual_func)
+		return virtual_select(tree, priv->virtual_top,
+		                      (gint64)priv->virtual_current - 1);
+
+	row = get_prev(priv->current);
 	if (!row)
 		return FALSE;
 	priv->current = row;
@@ -825,7 +1772,18 @@ action_page_down(GntBindable *bind, G_GNUC_UNUSED GList *unused)
 	GntTree *tree = GNT_TREE(bind);
 	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
 	GntTreeRow *old = priv->current;
-	GntTreeRow *row = get_next(priv->bottom);
+	GntTreeRow *row;
+
+	if (priv->virtual_func) {
+		int page = MAX(virtual_lines(tree) - 1, 1);
+		if (priv->virtual_top + page + 1 >= priv->virtual_count)
+			page = priv->virtual_count;
+		virtual_select(tree, (gint64)priv->virtual_top + page,
+		               (gint64)priv->virtual_current + page);
+		return TRUE;
+	}
+
+	row = get_next(priv->bottom);
 	if (row)
 	{
 		int dist = get_distance(priv->top, priv->current);
@@ -852,6 +1810,15 @@ action_page_up(GntBindable *bind, G_GNUC_UNUSED GList *unused)
 	GntTreeRow *row;
 	GntTreeRow *old = priv->current;
 
+	if (priv->virtual_func) {
+		int page = MAX(virtual_lines(tree) - 1, 1);
+		if (priv->virtual_top == 0)
+			page = priv->virtual_current;
+		virtual_select(tree, (gint64)priv->virtual_top - page,
+		               (gint64)priv->virtual_current - page);
+		return TRUE;
+	}
+
 	if (priv->top != priv->root) {
 		int dist = get_distance(priv->top, priv->current);
 		gint height;
@@ -883,6 +1850,9 @@ end_search(GntTree *tree)
 		g_string_free(priv->search, TRUE);
 		priv->search = NULL;
 		priv->search_timeout = 0;
+		g_clear_pointer(&priv->search_fold, g_free);
+		g_clear_pointer(&priv->matches, g_ptr_array_unref);
+		g_clear_pointer(&priv->counted, g_ptr_array_unref);
 		gnt_widget_set_disable_actions(GNT_WIDGET(tree), FALSE);
 	}
 }
@@ -918,6 +1888,7 @@ gnt_tree_key_pressed(GntWidget *widget, const char *text)
 		} else
 			changed = FALSE;
 		if (changed) {
+			search_text_changed(priv);
 			redraw_tree(tree);
 		} else {
 			gnt_bindable_perform_action_key(GNT_BINDABLE(tree), text);
@@ -931,13 +1902,14 @@ gnt_tree_key_pressed(GntWidget *widget, const char *text)
 		GntTreeRow *row = priv->current;
 		if (row && row->child)
 		{
-			row->collapsed = !row->collapsed;
+			set_collapsed(priv, row, !row->collapsed);
 			redraw_tree(tree);
 			g_signal_emit(tree, signals[SIG_COLLAPSED], 0, row->key, row->collapsed);
 		}
 		else if (row && row->choice)
 		{
 			row->isselected = !row->isselected;
+			row_text_changed(row);
 			g_signal_emit(tree, signals[SIG_TOGGLED], 0, row->key);
 			redraw_tree(tree);
 		}
@@ -966,10 +1938,31 @@ gnt_tree_destroy(GntWidget *widget)
 
 	end_search(tree);
 	if (priv->hash) {
+		free_all_rows(priv);
 		g_hash_table_destroy(priv->hash);
 	}
 	g_list_free(priv->list);
+	g_clear_pointer(&priv->root_index, g_sequence_free);
+	g_clear_pointer(&priv->virtual_rows, g_hash_table_destroy);
+	if (priv->virtual_notify)
+		priv->virtual_notify(priv->virtual_data);
 	gnt_tree_free_columns(priv);
+	if (priv->pool) {
+		GntTreePool *pool = priv->pool;
+
+		/* Rows that are not in the tree may still use the chunks */
+		if (pool->chunk) {
+			pool->chunk->current = FALSE;
+			if (pool->chunk->live == 0)
+				tree_chunk_free(pool->chunk);
+			pool->chunk = NULL;
+		}
+		if (pool->chunks == 0)
+			g_free(pool);
+		else
+			pool->orphan = TRUE;
+		priv->pool = NULL;
+	}
 }
 
 static gboolean
@@ -993,6 +1986,16 @@ gnt_tree_clicked(GntWidget *widget, GntMouseEvent event, G_GNUC_UNUSED int x,
 		}
 		gnt_widget_get_position(widget, NULL, &widgety);
 		pos = y - widgety - pos;
+		if (priv->virtual_func) {
+			gint64 index = (gint64)priv->virtual_top + pos;
+			if (pos < 0 || index >= priv->virtual_count)
+				return TRUE;
+			if (index == priv->virtual_current)
+				gnt_widget_activate(widget);
+			else
+				virtual_select(tree, priv->virtual_top, index);
+			return TRUE;
+		}
 		row = get_next_n(priv->top, pos);
 		if (row && priv->current != row) {
 			GntTreeRow *old = priv->current;
@@ -1002,6 +2005,7 @@ gnt_tree_clicked(GntWidget *widget, GntMouseEvent event, G_GNUC_UNUSED int x,
 		} else if (row && row == priv->current) {
 			if (row->choice) {
 				row->isselected = !row->isselected;
+				row_text_changed(row);
 				g_signal_emit(tree, signals[SIG_TOGGLED], 0, row->key);
 				redraw_tree(tree);
 			} else {
@@ -1038,7 +2042,7 @@ start_search(GntBindable *bindable, G_GNUC_UNUSED GList *params)
 	GntTree *tree = GNT_TREE(bindable);
 	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
 
-	if (priv->search) {
+	if (priv->search || priv->virtual_func) {
 		return FALSE;
 	}
 
@@ -1072,6 +2076,11 @@ move_first_action(GntBindable *bind, G_GNUC_UNUSED GList *params)
 	GntTreePrivate *priv = gnt_tree_get_instance_private(tree);
 	GntTreeRow *row = priv->root;
 	GntTreeRow *old = priv->current;
+
+	if (priv->virtual_func) {
+		virtual_select(tree, 0, 0);
+		return TRUE;
+	}
 	if (row && !row_matches_search(row)) {
 		row = get_next(row);
 	}
@@ -1094,8 +2103,18 @@ move_last_action(GntBindable *bind, G_GNUC_UNUSED GList *params)
 	GntTreeRow *row = priv->bottom;
 	GntTreeRow *next;
 
-	while ((next = get_next(row)))
-		row = next;
+	if (priv->virtual_func) {
+		virtual_select(tree, priv->virtual_count, priv->virtual_count);
+		return TRUE;
+	}
+	if (SEARCHING(priv)) {
+		while ((next = get_next(row)))
+			row = next;
+	} else {
+		for (row = priv->root; row && row->next; row = row->next)
+			;
+		row = get_last_child(row);
+	}
 
 	if (row) {
 		priv->current = row;
@@ -1124,6 +2143,7 @@ gnt_tree_set_property(GObject *obj, guint prop_id, const GValue *value,
 				break;
 			}
 			priv->expander_level = g_value_get_int(value);
+			layout_changed(priv);
 		default:
 			break;
 	}
@@ -1254,24 +2274,43 @@ gnt_tree_init(GntTree *tree)
  * GntTree API
  *****************************************************************************/
 static void
-free_tree_col(gpointer data)
+free_tree_row(gpointer data)
 {
-	GntTreeCol *col = data;
-	if (!col->isbinary)
-		g_free(col->text);
-	g_free(col);
+	GntTreeRow *row = data;
+	int i;
+
+	if (!row)
+		return;
+
+	for (i = 0; i < row->ncol; i++) {
+		GntTreeCol *col = &row->columns[i];
+		if (!col->isbinary && !col->isinline)
+			g_free(col->text);
+	}
+	g_free(row->text);
+	g_free(row->search_key);
+	if (row->index)
+		g_sequence_free(row->index);
+	if (!row->chunk->pool->dropping)
+		tree_chunk_release(row->chunk, row, row->size);
 }
 
+/* Free all the rows of the tree. If they are all the rows of the pool, which
+ * is unless some were created but not added, the chunks are dropped along
+ * with them instead of giving back each row. */
 static void
-free_tree_row(gpointer data)
+free_all_rows(GntTreePrivate *priv)
 {
-	GntTreeRow *row = data;
+	GntTreePool *pool = priv->pool;
 
-	if (!row)
+	if (pool == NULL || pool->live != g_hash_table_size(priv->hash)) {
+		g_hash_table_remove_all(priv->hash);
 		return;
-
-	g_list_free_full(row->columns, free_tree_col);
-	g_free(row);
+	}
+	pool->dropping = TRUE;
+	g_hash_table_remove_all(priv->hash);
+	pool->dropping = FALSE;
+	tree_pool_reset(pool);
 }
 
 GntWidget *gnt_tree_new()
@@ -1305,13 +2344,22 @@ int gnt_tree_get_visible_rows(GntTree *tree)
 	return ret;
 }
 
+/* The list is only built when somebody asks for it, and kept until the rows
+ * change, so adding and removing rows doesn't have to keep it in order. */
 GList *gnt_tree_get_rows(GntTree *tree)
 {
 	GntTreePrivate *priv = NULL;
+	GntTreeRow *row;
 
 	g_return_val_if_fail(GNT_IS_TREE(tree), NULL);
 	priv = gnt_tree_get_instance_private(tree);
 
+	if (priv->list == NULL) {
+		for (row = priv->root; row; row = _get_next(row, TRUE)) {
+			priv->list = g_list_prepend(priv->list, row->key);
+		}
+		priv->list = g_list_reverse(priv->list);
+	}
 	return priv->list;
 }
 
@@ -1323,9 +2371,27 @@ void gnt_tree_scroll(GntTree *tree, int count)
 	g_return_if_fail(GNT_IS_TREE(tree));
 	priv = gnt_tree_get_instance_private(tree);
 
+	if (priv->virtual_func) {
+		guint top = priv->virtual_top;
+		int lines = virtual_lines(tree);
+		gint64 newtop = (gint64)top + count;
+		gint64 current;
+
+		newtop = CLAMP(newtop, 0,
+		               MAX((gint64)priv->virtual_count - lines, 0));
+		/* Drag the selection along if it would leave the screen */
+		current = CLAMP((gint64)priv->virtual_current, newtop,
+		                newtop + lines - 1);
+		virtual_select(tree, newtop, current);
+		count = (int)priv->virtual_top - (int)top;
+		if (count)
+			g_signal_emit(tree, signals[SIG_SCROLLED], 0, count);
+		return;
+	}
+
 	if (count < 0)
 	{
-		if (get_root_distance(priv->top) == 0) {
+		if (get_prev(priv->top) == NULL) {
 			return;
 		}
 		row = get_prev_n(priv->top, -count);
@@ -1343,44 +2409,208 @@ void gnt_tree_scroll(GntTree *tree, int count)
 	g_signal_emit(tree, signals[SIG_SCROLLED], 0, count);
 }
 
-static gpointer
-find_position(GntTreePrivate *priv, gpointer key, gpointer parent)
+static gint
+compare_rows(gconstpointer a, gconstpointer b, gpointer data)
 {
+	GntTreePrivate *priv = data;
+
+	return priv->compare(((GntTreeRow *)a)->key, ((GntTreeRow *)b)->key);
+}
+
+/* The siblings get an index the first time a row has to be put in order
+ * among them, so that the position can be found with a binary search. That
+ * only works while they are sorted, so there is no index for siblings that
+ * are out of order (not counting @exclude, which is being sorted), and it is
+ * dropped when a row is put out of order among them, or the comparison
+ * changes. Otherwise the index follows the order of the siblings until they
+ * are removed, or sorted after a batch.
+ *
+ * Siblings that were found out of order are remembered as such until they are
+ * sorted, or the comparison changes, so they are not looked through again
+ * every time a row is put among them. */
+static GSequence *
+get_index(GntTreePrivate *priv, GntTreeRow *parent, GntTreeRow *exclude)
+{
+	GSequence **index = parent ? &parent->index : &priv->root_index;
+	gboolean *out_of_order = parent ? &parent->out_of_order
+	                                : &priv->root_out_of_order;
+	GntTreeRow *row, *prev = NULL;
+
+	if (*index == NULL) {
+		if (*out_of_order)
+			return NULL;
+		for (row = parent ? parent->child : priv->root; row; row = row->next) {
+			if (row == exclude)
+				continue;
+			if (prev && priv->compare(prev->key, row->key) > 0) {
+				*out_of_order = TRUE;
+				return NULL;
+			}
+			prev = row;
+		}
+		*index = g_sequence_new(NULL);
+		for (row = parent ? parent->child : priv->root; row; row = row->next)
+			row->iter = g_sequence_append(*index, row);
+	}
+	return *index;
+}
+
+static void
+drop_index(GntTreePrivate *priv, GntTreeRow *parent)
+{
+	GSequence **index = parent ? &parent->index : &priv->root_index;
 	GntTreeRow *row;
 
+	if (*index == NULL)
+		return;
+	for (row = parent ? parent->child : priv->root; row; row = row->next)
+		row->iter = NULL;
+	g_clear_pointer(index, g_sequence_free);
+}
+
+/* Put a row that was just linked to its siblings in their index. */
+static void
+index_add(GntTreePrivate *priv, GntTreeRow *row)
+{
+	GSequence *index = row->parent ? row->parent->index : priv->root_index;
+	gboolean *out_of_order = row->parent ? &row->parent->out_of_order
+	                                     : &priv->root_out_of_order;
+
+	if (priv->compare == NULL || *out_of_order)
+		return;
+	/* An explicit position, or a batch, may put the row out of order */
+	if ((row->prev && priv->compare(row->prev->key, row->key) > 0) ||
+	    (row->next && priv->compare(row->key, row->next->key) > 0)) {
+		drop_index(priv, row->parent);
+		*out_of_order = TRUE;
+		return;
+	}
+	if (index == NULL)
+		return;
+	row->iter = g_sequence_insert_before(
+	        row->next ? row->next->iter : g_sequence_get_end_iter(index), row);
+}
+
+static void
+index_remove(GntTreeRow *row)
+{
+	if (row->iter) {
+		g_sequence_remove(row->iter);
+		row->iter = NULL;
+	}
+}
+
+/* Returns the key of the row after which row should be added, or NULL if it
+ * should be the first child of parent. */
+static gpointer
+find_position(GntTreePrivate *priv, GntTreeRow *row, gpointer parent)
+{
+	GntTreeRow *pr = NULL, *prev = NULL, *s;
+	GSequence *index;
+	GSequenceIter *iter;
+
 	if (priv->compare == NULL) {
 		return NULL;
 	}
 
-	if (parent == NULL)
-		row = priv->root;
-	else
-		row = g_hash_table_lookup(priv->hash, parent);
+	if (parent) {
+		pr = g_hash_table_lookup(priv->hash, parent);
+		if (!pr)
+			return NULL;
+	}
 
-	if (!row)
+	index = get_index(priv, pr, NULL);
+	if (index == NULL) {
+		/* Go before the first sibling that the row sorts before */
+		for (s = pr ? pr->child : priv->root; s; prev = s, s = s->next) {
+			if (priv->compare(row->key, s->key) < 0)
+				break;
+		}
+		return prev ? prev->key : NULL;
+	}
+
+	iter = g_sequence_search(index, row, compare_rows, priv);
+	if (g_sequence_iter_is_begin(iter))
 		return NULL;
+	row = g_sequence_get(g_sequence_iter_prev(iter));
+	return row->key;
+}
 
+/* In a batch, rows are added to the front of their siblings without looking
+ * for their position, and the siblings are sorted when the batch ends. */
+static void
+defer_sort(GntTreePrivate *priv, GntTreeRow *parent)
+{
 	if (parent)
-		row = row->child;
+		parent->unsorted = TRUE;
+	else
+		priv->root_unsorted = TRUE;
+	priv->unsorted = TRUE;
+}
 
-	while (row)
-	{
-		if (priv->compare(key, row->key) < 0) {
-			return (row->prev ? row->prev->key : NULL);
-		}
-		if (row->next)
+/* Merge sort a list of siblings, linked by next only. */
+static GntTreeRow *
+sort_rows(GntTreeRow *row, GCompareFunc compare)
+{
+	GntTreeRow *slow, *fast, *second;
+	GntTreeRow *head = NULL, **tail = &head;
+
+	if (row == NULL || row->next == NULL)
+		return row;
+
+	slow = row;
+	fast = row->next;
+	while (fast && fast->next) {
+		slow = slow->next;
+		fast = fast->next->next;
+	}
+	second = slow->next;
+	slow->next = NULL;
+
+	row = sort_rows(row, compare);
+	second = sort_rows(second, compare);
+
+	while (row && second) {
+		if (compare(second->key, row->key) < 0) {
+			*tail = second;
+			second = second->next;
+		} else {
+			*tail = row;
 			row = row->next;
-		else
-			return row->key;
+		}
+		tail = &(*tail)->next;
 	}
-	return NULL;
+	*tail = row ? row : second;
+
+	return head;
+}
+
+static void
+sort_children(GntTreePrivate *priv, GntTreeRow *parent)
+{
+	GntTreeRow *row, *prev = NULL;
+
+	drop_index(priv, parent);
+	row = sort_rows(parent ? parent->child : priv->root, priv->compare);
+	if (parent) {
+		parent->child = row;
+		parent->out_of_order = FALSE;
+	} else {
+		priv->root = row;
+		priv->root_out_of_order = FALSE;
+	}
+
+	for (; row; prev = row, row = row->next)
+		row->prev = prev;
+	count_rebuild(priv, parent);
 }
 
 void gnt_tree_sort_row(GntTree *tree, gpointer key)
 {
 	GntTreePrivate *priv = NULL;
-	GntTreeRow *row, *q, *s;
-	int current, newp;
+	GntTreeRow *row, *prev, *next, **first;
+	GSequence *index;
+	GSequenceIter *iter;
 
 	g_return_if_fail(GNT_IS_TREE(tree));
 	priv = gnt_tree_get_instance_private(tree);
@@ -1392,62 +2622,56 @@ void gnt_tree_sort_row(GntTree *tree, gpointer key)
 	row = g_hash_table_lookup(priv->hash, key);
 	g_return_if_fail(row != NULL);
 
-	current = g_list_index(priv->list, key);
-
-	if (row->parent)
-		s = row->parent->child;
-	else
-		s = priv->root;
-
-	q = NULL;
-	while (s) {
-		if (priv->compare(row->key, s->key) < 0) {
-			break;
-		}
-		q = s;
-		s = s->next;
+	if (priv->batch) {
+		defer_sort(priv, row->parent);
+		return;
 	}
 
-	/* Move row between q and s */
-	if (row == q || row == s)
-		return;
+	/* Find the new place of the row in the index, and move it there */
+	index = get_index(priv, row->parent, row);
+	if (index) {
+		g_sequence_remove(row->iter);
+		iter = g_sequence_search(index, row, compare_rows, priv);
+		row->iter = g_sequence_insert_before(iter, row);
 
-	if (q == NULL) {
-		/* row becomes the first child of its parent */
-		row->prev->next = row->next;  /* row->prev cannot be NULL at this point */
-		if (row->next)
-			row->next->prev = row->prev;
-		if (row->parent)
-			row->parent->child = row;
-		else
-			priv->root = row;
-		row->next = s;
-		g_return_if_fail(s != NULL); /* s cannot be NULL */
-		s->prev = row;
-		row->prev = NULL;
-		newp = g_list_index(priv->list, s) - 1;
+		next = g_sequence_iter_is_end(iter) ? NULL : g_sequence_get(iter);
+		prev = g_sequence_iter_is_begin(row->iter)
+		               ? NULL
+		               : g_sequence_get(g_sequence_iter_prev(row->iter));
 	} else {
-		if (row->prev) {
-			row->prev->next = row->next;
-		} else {
-			/* row was the first child of its parent */
-			if (row->parent)
-				row->parent->child = row->next;
-			else
-				priv->top = row->next;
+		/* The siblings are out of order: go before the first one that
+		 * the row sorts before */
+		prev = NULL;
+		for (next = row->parent ? row->parent->child : priv->root; next;
+		     prev = next, next = next->next) {
+			if (priv->compare(row->key, next->key) < 0)
+				break;
 		}
+		if (row == prev || row == next)
+			return;
+	}
+	if (row->next == next && row->prev == prev)
+		return;
 
-		if (row->next)
-			row->next->prev = row->prev;
+	count_remove(priv, row);
+	first = row->parent ? &row->parent->child : &priv->root;
+	if (row->prev)
+		row->prev->next = row->next;
+	else
+		*first = row->next;
+	if (row->next)
+		row->next->prev = row->prev;
 
-		q->next = row;
-		row->prev = q;
-		if (s)
-			s->prev = row;
-		row->next = s;
-		newp = g_list_index(priv->list, q) + 1;
-	}
-	priv->list = g_list_reposition_child(priv->list, current, newp);
+	row->prev = prev;
+	row->next = next;
+	if (prev)
+		prev->next = row;
+	else
+		*first = row;
+	if (next)
+		next->prev = row;
+	count_insert(priv, row);
+	rows_changed(priv);
 
 	redraw_tree(tree);
 }
@@ -1459,6 +2683,7 @@ GntTreeRow *gnt_tree_add_row_after(GntTree *tree, void *key, GntTreeRow *row, vo
 
 	g_return_val_if_fail(GNT_IS_TREE(tree), NULL);
 	priv = gnt_tree_get_instance_private(tree);
+	g_return_val_if_fail(priv->virtual_func == NULL, NULL);
 
 	if (g_hash_table_lookup(priv->hash, key)) {
 		gnt_tree_remove(tree, key);
@@ -1468,17 +2693,19 @@ GntTreeRow *gnt_tree_add_row_after(GntTree *tree, void *key, GntTreeRow *row, vo
 	row->key = key;
 	row->data = NULL;
 	g_hash_table_replace(priv->hash, key, row);
+	search_rows_changed(priv);
 
 	if (bigbro == NULL && priv->compare) {
-		bigbro = find_position(priv, key, parent);
+		if (priv->batch)
+			defer_sort(priv, parent ? g_hash_table_lookup(priv->hash, parent) : NULL);
+		else
+			bigbro = find_position(priv, row, parent);
 	}
 
+	rows_changed(priv);
 	if (priv->root == NULL) {
 		priv->root = row;
-		priv->list = g_list_prepend(priv->list, key);
 	} else {
-		int position = 0;
-
 		if (bigbro)
 		{
 			pr = g_hash_table_lookup(priv->hash, bigbro);
@@ -1489,8 +2716,6 @@ GntTreeRow *gnt_tree_add_row_after(GntTree *tree, void *key, GntTreeRow *row, vo
 				row->prev = pr;
 				pr->next = row;
 				row->parent = pr->parent;
-
-				position = g_list_index(priv->list, bigbro);
 			}
 		}
 
@@ -1503,8 +2728,7 @@ GntTreeRow *gnt_tree_add_row_after(GntTree *tree, void *key, GntTreeRow *row, vo
 				row->next = pr->child;
 				pr->child = row;
 				row->parent = pr;
-
-				position = g_list_index(priv->list, parent);
+				row_text_changed(pr);  /* for the expander */
 			}
 		}
 
@@ -1517,14 +2741,11 @@ GntTreeRow *gnt_tree_add_row_after(GntTree *tree, void *key, GntTreeRow *row, vo
 				priv->current = row;
 			}
 			priv->root = row;
-			priv->list = g_list_prepend(priv->list, key);
-		}
-		else
-		{
-			priv->list =
-			        g_list_insert(priv->list, key, position + 1);
 		}
 	}
+	index_add(priv, row);
+	count_insert(priv, row);
+	row_height_changed(priv, row, row_height(row));
 	redraw_tree(tree);
 
 	return row;
@@ -1562,6 +2783,8 @@ gpointer gnt_tree_get_selection_data(GntTree *tree)
 	g_return_val_if_fail(GNT_IS_TREE(tree), NULL);
 	priv = gnt_tree_get_instance_private(tree);
 
+	if (priv->virtual_func)
+		return virtual_selection_key(tree);
 	if (priv->current) {
 		/* XXX: perhaps we should just get rid of 'data' */
 		return priv->current->key;
@@ -1576,6 +2799,9 @@ char *gnt_tree_get_selection_text(GntTree *tree)
 	g_return_val_if_fail(GNT_IS_TREE(tree), NULL);
 	priv = gnt_tree_get_instance_private(tree);
 
+	if (priv->virtual_func && priv->virtual_count)
+		return update_row_text(
+		        priv, virtual_get_row(tree, priv->virtual_current));
 	if (priv->current) {
 		return update_row_text(priv, priv->current);
 	}
@@ -1585,21 +2811,25 @@ char *gnt_tree_get_selection_text(GntTree *tree)
 GList *gnt_tree_get_row_text_list(GntTree *tree, gpointer key)
 {
 	GntTreePrivate *priv = NULL;
-	GList *list = NULL, *iter;
+	GList *list = NULL;
 	GntTreeRow *row = NULL;
 	int i;
 
 	g_return_val_if_fail(GNT_IS_TREE(tree), NULL);
 	priv = gnt_tree_get_instance_private(tree);
 
-	row = key ? g_hash_table_lookup(priv->hash, key) : priv->current;
+	if (key)
+		row = g_hash_table_lookup(priv->hash, key);
+	else if (priv->virtual_func && priv->virtual_count)
+		row = virtual_get_row(tree, priv->virtual_current);
+	else
+		row = priv->current;
 
 	if (!row)
 		return NULL;
 
-	for (i = 0, iter = row->columns; i < priv->ncol && iter;
-	     i++, iter = iter->next) {
-		GntTreeCol *col = iter->data;
+	for (i = 0; i < priv->ncol && i < row->ncol; i++) {
+		GntTreeCol *col = &row->columns[i];
 		list = g_list_append(list, BINARY_DATA(priv, i)
 		                                   ? col->text
 		                                   : g_strdup(col->text));
@@ -1613,71 +2843,105 @@ GList *gnt_tree_get_selection_text_list(GntTree *tree)
 	return gnt_tree_get_row_text_list(tree, NULL);
 }
 
+/* Whether row is ancestor or one of its children. */
+static gboolean
+row_is_in(GntTreeRow *row, GntTreeRow *ancestor)
+{
+	for (; row; row = row->parent)
+		if (row == ancestor)
+			return TRUE;
+	return FALSE;
+}
+
+/* Free a row that was unlinked from the tree, along with all its children.
+ * The children are freed from the first one down, so that each row is left
+ * without children when its turn comes. */
+static void
+free_subtree(GntTreePrivate *priv, GntTreeRow *row)
+{
+	GntTreeRow *parent, *next;
+
+	while (row) {
+		if (row->child) {
+			row = row->child;
+			continue;
+		}
+		parent = row->parent;
+		if (parent)
+			parent->child = row->next;
+		next = row->next ? row->next : parent;
+		g_hash_table_remove(priv->hash, row->key);
+		row = next;
+	}
+}
+
 void gnt_tree_remove(GntTree *tree, gpointer key)
 {
 	GntTreePrivate *priv = NULL;
 	GntTreeRow *row = NULL;
-	static int depth = 0; /* Only redraw after all child nodes are removed */
+	GntTreeRow *prev, *next;
+	gboolean redraw = FALSE;
 
 	g_return_if_fail(GNT_IS_TREE(tree));
 	priv = gnt_tree_get_instance_private(tree);
 
 	row = g_hash_table_lookup(priv->hash, key);
-	if (row)
-	{
-		gboolean redraw = FALSE;
+	if (row == NULL)
+		return;
 
-		if (row->child) {
-			depth++;
-			while (row->child) {
-				gnt_tree_remove(tree, row->child->key);
-			}
-			depth--;
-		}
+	if (priv->batch) {
+		priv->needs_draw = TRUE;
+	} else if (gnt_widget_get_mapped(GNT_WIDGET(tree)) &&
+	           (row_is_in(priv->top, row) ||
+	            (get_distance(priv->top, row) >= 0 &&
+	             get_distance(row, priv->bottom) >= 0))) {
+		redraw = TRUE;
+	}
 
-		if (get_distance(priv->top, row) >= 0 &&
-		    get_distance(row, priv->bottom) >= 0) {
-			redraw = TRUE;
-		}
+	/* The rows shown before and after the row and its children */
+	prev = get_prev(row);
+	next = _get_next(row, FALSE);
+	if (next && !row_matches_search(next))
+		next = get_next(next);
 
-		/* Update root/top/current/bottom if necessary */
-		if (priv->root == row) {
-			priv->root = get_next(row);
-		}
-		if (priv->top == row) {
-			if (priv->top != priv->root) {
-				priv->top = get_prev(row);
-			} else {
-				priv->top = get_next(row);
-			}
-		}
-		if (priv->current == row) {
-			if (priv->current != priv->root) {
-				priv->current = get_prev(row);
-			} else {
-				priv->current = get_next(row);
-			}
-			tree_selection_changed(tree, row, priv->current);
-		}
-		if (priv->bottom == row) {
-			priv->bottom = get_prev(row);
-		}
+	/* Update root/top/current/bottom if necessary */
+	if (priv->root == row) {
+		priv->root = row->next;
+	}
+	if (row_is_in(priv->top, row)) {
+		priv->top = prev ? prev : next;
+	}
+	if (row_is_in(priv->current, row)) {
+		GntTreeRow *old = priv->current;
+		priv->current = prev ? prev : next;
+		tree_selection_changed(tree, old, priv->current);
+	}
+	if (row_is_in(priv->bottom, row)) {
+		priv->bottom = prev;
+	}
 
-		/* Fix the links */
-		if (row->next)
-			row->next->prev = row->prev;
-		if (row->parent && row->parent->child == row)
-			row->parent->child = row->next;
-		if (row->prev)
-			row->prev->next = row->next;
+	/* Fix the links */
+	index_remove(row);
+	row_height_changed(priv, row, -row_height(row));
+	count_remove(priv, row);
+	if (row->next)
+		row->next->prev = row->prev;
+	if (row->parent && row->parent->child == row) {
+		row->parent->child = row->next;
+		row_text_changed(row->parent);
+	}
+	if (row->prev)
+		row->prev->next = row->next;
+	row->parent = row->next = row->prev = NULL;
 
-		g_hash_table_remove(priv->hash, key);
-		priv->list = g_list_remove(priv->list, key);
+	free_subtree(priv, row);
+	/* Only now, as the matches may be looked for until the row is gone */
+	search_rows_changed(priv);
+	rows_changed(priv);
 
-		if (redraw && depth == 0)
-		{
-			redraw_tree(tree);
-		}
+	if (redraw)
+	{
+		redraw_tree(tree);
 	}
 }
 
@@ -1688,11 +2952,56 @@ void gnt_tree_remove_all(GntTree *tree)
 	g_return_if_fail(GNT_IS_TREE(tree));
 	priv = gnt_tree_get_instance_private(tree);
 
-	priv->root = NULL;
-	g_hash_table_remove_all(priv->hash);
-	g_list_free(priv->list);
-	priv->list = NULL;
+	priv->root = priv->count_root = NULL;
+	free_all_rows(priv);
+	g_clear_pointer(&priv->root_index, g_sequence_free);
+	rows_changed(priv);
+	search_rows_changed(priv);
+	priv->visible = 0;
 	priv->current = priv->top = priv->bottom = NULL;
+	priv->unsorted = priv->root_unsorted = FALSE;
+	priv->root_out_of_order = FALSE;
+}
+
+void gnt_tree_begin_batch(GntTree *tree)
+{
+	GntTreePrivate *priv = NULL;
+
+	g_return_if_fail(GNT_IS_TREE(tree));
+	priv = gnt_tree_get_instance_private(tree);
+
+	priv->batch++;
+}
+
+void gnt_tree_end_batch(GntTree *tree)
+{
+	GntTreePrivate *priv = NULL;
+	GntTreeRow *row;
+
+	g_return_if_fail(GNT_IS_TREE(tree));
+	priv = gnt_tree_get_instance_private(tree);
+	g_return_if_fail(priv->batch > 0);
+
+	if (--priv->batch > 0)
+		return;
+
+	if (priv->unsorted) {
+		if (priv->root_unsorted && priv->compare)
+			sort_children(priv, NULL);
+		for (row = priv->root; row; row = _get_next(row, TRUE)) {
+			if (row->unsorted && priv->compare)
+				sort_children(priv, row);
+			row->unsorted = FALSE;
+		}
+		priv->unsorted = priv->root_unsorted = FALSE;
+		rows_changed(priv);
+		priv->needs_draw = TRUE;
+	}
+
+	if (priv->needs_draw) {
+		priv->needs_draw = FALSE;
+		redraw_tree(tree);
+	}
 }
 
 int gnt_tree_get_selection_visible_line(GntTree *tree)
@@ -1702,6 +3011,9 @@ int gnt_tree_get_selection_visible_line(GntTree *tree)
 	g_return_val_if_fail(GNT_IS_TREE(tree), 0);
 	priv = gnt_tree_get_instance_private(tree);
 
+	if (priv->virtual_func)
+		return priv->virtual_current - priv->virtual_top +
+		       !gnt_widget_get_has_border(GNT_WIDGET(tree));
 	return get_distance(priv->top, priv->current) +
 	       !gnt_widget_get_has_border(GNT_WIDGET(tree));
 }
@@ -1717,21 +3029,22 @@ void gnt_tree_change_text(GntTree *tree, gpointer key, int colno, const char *te
 	g_return_if_fail(colno < priv->ncol);
 
 	row = g_hash_table_lookup(priv->hash, key);
-	if (row)
+	if (row && colno < row->ncol)
 	{
-		col = g_list_nth_data(row->columns, colno);
+		col = &row->columns[colno];
 		if (BINARY_DATA(priv, colno)) {
 			col->text = (gpointer)text;
 		} else {
-			g_free(col->text);
+			if (!col->isinline)
+				g_free(col->text);
 			col->text = g_strdup(text ? text : "");
+			col->isinline = FALSE;
 		}
+		row_text_changed(row);
+		g_clear_pointer(&row->search_key, g_free);
+		search_rows_changed(priv);
 
-		if (gnt_widget_get_mapped(GNT_WIDGET(tree)) &&
-		    get_distance(priv->top, row) >= 0 &&
-		    get_distance(row, priv->bottom) >= 0) {
-			redraw_tree(tree);
-		}
+		redraw_row(tree, row);
 	}
 }
 
@@ -1746,24 +3059,22 @@ GntTreeRow *gnt_tree_add_choice(GntTree *tree, void *key, GntTreeRow *row, void
 	r = g_hash_table_lookup(priv->hash, key);
 	g_return_val_if_fail(!r || !r->choice, NULL);
 
-	if (bigbro == NULL) {
-		if (priv->compare) {
-			bigbro = find_position(priv, key, parent);
-		} else {
-			r = g_hash_table_lookup(priv->hash, parent);
-			if (!r)
-				r = priv->root;
-			else
-				r = r->child;
-			if (r) {
-				while (r->next)
-					r = r->next;
-				bigbro = r->key;
-			}
+	/* With a compare function, gnt_tree_add_row_after finds the position */
+	if (bigbro == NULL && priv->compare == NULL) {
+		r = g_hash_table_lookup(priv->hash, parent);
+		if (!r)
+			r = priv->root;
+		else
+			r = r->child;
+		if (r) {
+			while (r->next)
+				r = r->next;
+			bigbro = r->key;
 		}
 	}
 	row = gnt_tree_add_row_after(tree, key, row, parent, bigbro);
 	row->choice = TRUE;
+	row_text_changed(row);
 
 	return row;
 }
@@ -1783,7 +3094,8 @@ void gnt_tree_set_choice(GntTree *tree, void *key, gboolean set)
 	g_return_if_fail(row->choice);
 
 	row->isselected = set;
-	redraw_tree(tree);
+	row_text_changed(row);
+	redraw_row(tree, row);
 }
 
 gboolean gnt_tree_get_choice(GntTree *tree, void *key)
@@ -1816,7 +3128,7 @@ void gnt_tree_set_row_flags(GntTree *tree, void *key, GntTextFormatFlags flags)
 		return;
 
 	row->flags = flags;
-	redraw_tree(tree);	/* XXX: It shouldn't be necessary to redraw the whole darned tree */
+	redraw_row(tree, row);
 }
 
 void gnt_tree_set_row_color(GntTree *tree, void *key, int color)
@@ -1832,7 +3144,7 @@ void gnt_tree_set_row_color(GntTree *tree, void *key, int color)
 		return;
 
 	row->color = color;
-	redraw_tree(tree);
+	redraw_row(tree, row);
 }
 
 void gnt_tree_set_selected(GntTree *tree , void *key)
@@ -1917,56 +3229,80 @@ GntWidget *gnt_tree_new_with_columns(int col)
 	return widget;
 }
 
-GntTreeRow *gnt_tree_create_row_from_list(GntTree *tree, GList *list)
+/* Allocate a row, its columns and their text in one go. */
+static GntTreeRow *
+create_row(GntTreePrivate *priv, gpointer *data, int ncol)
 {
-	GntTreePrivate *priv = NULL;
-	GList *iter;
 	int i;
+	gsize size, len;
 	GntTreeRow *row;
+	GntTreeChunk *chunk;
+	char *text;
 
-	g_return_val_if_fail(GNT_IS_TREE(tree), NULL);
-	priv = gnt_tree_get_instance_private(tree);
+	size = 0;
+	for (i = 0; i < ncol; i++) {
+		if (!BINARY_DATA(priv, i))
+			size += (data[i] ? strlen(data[i]) : 0) + 1;
+	}
+	row = tree_chunk_alloc(priv, ROW_SIZE(ncol) + size, &chunk, &size);
+	row->chunk = chunk;
+	row->size = size;
+	row->ncol = ncol;
+	text = (char *)row + ROW_SIZE(ncol);
 
-	row = g_new0(GntTreeRow, 1);
-	for (i = 0, iter = list; i < priv->ncol && iter;
-	     iter = iter->next, i++) {
-		GntTreeCol *col = g_new0(GntTreeCol, 1);
+	for (i = 0; i < ncol; i++) {
+		GntTreeCol *col = &row->columns[i];
 		col->span = 1;
 		if (BINARY_DATA(priv, i)) {
-			col->text = iter->data;
+			col->text = data[i];
 			col->isbinary = TRUE;
 		} else {
-			col->text = g_strdup(iter->data ? iter->data : "");
-			col->isbinary = FALSE;
+			len = data[i] ? strlen(data[i]) : 0;
+			col->text = text;
+			col->isinline = TRUE;
+			memcpy(text, data[i] ? data[i] : "", len);
+			text += len + 1;
 		}
-
-		row->columns = g_list_append(row->columns, col);
 	}
 
 	return row;
 }
 
+GntTreeRow *gnt_tree_create_row_from_list(GntTree *tree, GList *list)
+{
+	GntTreePrivate *priv = NULL;
+	gpointer *data;
+	int ncol;
+
+	g_return_val_if_fail(GNT_IS_TREE(tree), NULL);
+	priv = gnt_tree_get_instance_private(tree);
+
+	data = g_newa(gpointer, priv->ncol);
+	for (ncol = 0; ncol < priv->ncol && list; list = list->next, ncol++) {
+		data[ncol] = list->data;
+	}
+
+	return create_row(priv, data, ncol);
+}
+
 GntTreeRow *gnt_tree_create_row(GntTree *tree, ...)
 {
 	GntTreePrivate *priv = NULL;
 	int i;
 	va_list args;
-	GList *list = NULL;
-	GntTreeRow *row;
+	gpointer *data;
 
 	g_return_val_if_fail(GNT_IS_TREE(tree), NULL);
 	priv = gnt_tree_get_instance_private(tree);
 
+	data = g_newa(gpointer, priv->ncol);
 	va_start(args, tree);
 	for (i = 0; i < priv->ncol; i++) {
-		list = g_list_append(list, va_arg(args, char *));
+		data[i] = va_arg(args, char *);
 	}
 	va_end(args);
 
-	row = gnt_tree_create_row_from_list(tree, list);
-	g_list_free(list);
-
-	return row;
+	return create_row(priv, data, priv->ncol);
 }
 
 void gnt_tree_set_col_width(GntTree *tree, int col, int width)
@@ -1977,6 +3313,8 @@ void gnt_tree_set_col_width(GntTree *tree, int col, int width)
 	priv = gnt_tree_get_instance_private(tree);
 	g_return_if_fail(col < priv->ncol);
 
+	if (priv->columns[col].width != width)
+		layout_changed(priv);
 	priv->columns[col].width = width;
 	if (priv->columns[col].width_ratio == 0) {
 		priv->columns[col].width_ratio = width;
@@ -2027,10 +3365,21 @@ void gnt_tree_set_show_title(GntTree *tree, gboolean set)
 void gnt_tree_set_compare_func(GntTree *tree, GCompareFunc func)
 {
 	GntTreePrivate *priv = NULL;
+	GntTreeRow *row;
 
 	g_return_if_fail(GNT_IS_TREE(tree));
 	priv = gnt_tree_get_instance_private(tree);
 
+	if (priv->compare == func)
+		return;
+
+	/* The siblings are not known to be in the new order, or out of it */
+	drop_index(priv, NULL);
+	priv->root_out_of_order = FALSE;
+	for (row = priv->root; row; row = _get_next(row, TRUE)) {
+		drop_index(priv, row);
+		row->out_of_order = FALSE;
+	}
 	priv->compare = func;
 }
 
@@ -2044,7 +3393,7 @@ void gnt_tree_set_expanded(GntTree *tree, void *key, gboolean expanded)
 
 	row = g_hash_table_lookup(priv->hash, key);
 	if (row) {
-		row->collapsed = !expanded;
+		set_collapsed(priv, row, !expanded);
 		if (gnt_widget_get_window(GNT_WIDGET(tree))) {
 			gnt_widget_draw(GNT_WIDGET(tree));
 		}
@@ -2060,6 +3409,7 @@ void gnt_tree_set_show_separator(GntTree *tree, gboolean set)
 	priv = gnt_tree_get_instance_private(tree);
 
 	priv->show_separator = set;
+	layout_changed(priv);
 }
 
 void gnt_tree_adjust_columns(GntTree *tree)
@@ -2074,9 +3424,8 @@ void gnt_tree_adjust_columns(GntTree *tree)
 	widths = g_new0(int, priv->ncol);
 	row = priv->root;
 	while (row) {
-		GList *iter;
-		for (i = 0, iter = row->columns; iter; iter = iter->next, i++) {
-			GntTreeCol *col = iter->data;
+		for (i = 0; i < row->ncol; i++) {
+			GntTreeCol *col = &row->columns[i];
 			int w = gnt_util_onscreen_width(col->text, NULL);
 			if (i == 0 && row->choice)
 				w += 4;
@@ -2127,6 +3476,7 @@ set_column_flag(GntTreePrivate *priv, int col, GntTreeColumnFlag flag, gboolean
 		priv->columns[col].flags |= flag;
 	else
 		priv->columns[col].flags &= ~flag;
+	layout_changed(priv);
 }
 
 void gnt_tree_set_column_visible(GntTree *tree, int col, gboolean vis)
@@ -2214,6 +3564,7 @@ void gnt_tree_set_search_column(GntTree *tree, int col)
 	g_return_if_fail(!BINARY_DATA(priv, col));
 
 	priv->search_column = col;
+	search_rows_changed(priv);
 }
 
 gboolean gnt_tree_is_searching(GntTree *tree)
@@ -2235,6 +3586,76 @@ void gnt_tree_set_search_function(GntTree *tree,
 	priv = gnt_tree_get_instance_private(tree);
 
 	priv->search_func = func;
+	search_rows_changed(priv);
+}
+
+int gnt_tree_get_search_match_count(GntTree *tree)
+{
+	GntTreePrivate *priv = NULL;
+
+	g_return_val_if_fail(GNT_IS_TREE(tree), -1);
+	priv = gnt_tree_get_instance_private(tree);
+
+	if (priv->search == NULL)
+		return -1;
+	if (!SEARCHING(priv))
+		return priv->visible;
+	return get_search_visible(priv);
+}
+
+void gnt_tree_set_virtual(GntTree *tree, GntTreeVirtualFunc func,
+                          gpointer data, GDestroyNotify notify)
+{
+	GntTreePrivate *priv = NULL;
+
+	g_return_if_fail(GNT_IS_TREE(tree));
+	priv = gnt_tree_get_instance_private(tree);
+
+	end_search(tree);
+	gnt_tree_remove_all(tree);
+	g_clear_pointer(&priv->virtual_rows, g_hash_table_destroy);
+	if (priv->virtual_notify)
+		priv->virtual_notify(priv->virtual_data);
+
+	priv->virtual_func = func;
+	priv->virtual_data = data;
+	priv->virtual_notify = notify;
+	priv->virtual_count = priv->virtual_top = priv->virtual_current = 0;
+	if (func) {
+		priv->virtual_rows = g_hash_table_new_full(
+		        g_direct_hash, g_direct_equal, NULL, free_tree_row);
+	}
+	redraw_tree(tree);
+}
+
+void gnt_tree_set_virtual_count(GntTree *tree, guint count)
+{
+	GntTreePrivate *priv = NULL;
+	GntTreeRow *row;
+	gboolean fetch;
+	gpointer old;
+
+	g_return_if_fail(GNT_IS_TREE(tree));
+	priv = gnt_tree_get_instance_private(tree);
+	g_return_if_fail(priv->virtual_func != NULL);
+
+	/* The data behind the rows has already changed, so the key of the old
+	 * selection is only known if its row was fetched. Otherwise it is
+	 * taken from the new data, for an index that still exists there. */
+	row = g_hash_table_lookup(priv->virtual_rows,
+	                          GUINT_TO_POINTER(priv->virtual_current));
+	old = row ? row->key : NULL;
+	fetch = row == NULL && priv->virtual_current < MIN(priv->virtual_count, count);
+	g_hash_table_remove_all(priv->virtual_rows);
+	priv->virtual_count = count;
+	if (fetch)
+		old = virtual_selection_key(tree);
+	virtual_scroll(tree);
+	redraw_tree(tree);
+	if (old != virtual_selection_key(tree)) {
+		g_signal_emit(tree, signals[SIG_SELECTION_CHANGED], 0, old,
+		              virtual_selection_key(tree));
+	}
 }
 
 gpointer gnt_tree_get_parent_key(GntTree *tree, gpointer key)
@@ -86,6 +86,23 @@ typedef gboolean (*GntTreeSearchFunc)(GntTree *tree, gpointer key,
                                       const gchar *search,
                                       const gchar *current);
 
+/**
+ * GntTreeVirtualFunc:
+ * @tree: The tree being drawn.
+ * @index: The index of the row to draw.
+ * @key: (out): Return location for the key of the row, which is used as the
+ *       selection data and in the signals of the tree.
+ * @data: The data given to gnt_tree_set_virtual().
+ *
+ * Gives a row of a virtual tree when it is about to be shown.
+ *
+ * Returns: (transfer full): A row created with gnt_tree_create_row().
+ *
+ * Since: 3.0.0
+ */
+typedef GntTreeRow *(*GntTreeVirtualFunc)(GntTree *tree, guint index,
+                                          gpointer *key, gpointer data);
+
 /**
  * gnt_tree_row_get_type:
  *
@@ -306,10 +323,12 @@ GList * gnt_tree_get_selection_text_list(GntTree *tree);
  * gnt_tree_get_rows:
  * @tree:  The tree
  *
- * Returns the list of rows in the tree.
+ * Returns the list of rows in the tree, in the order they appear in the tree
+ * (including the children of collapsed rows).
  *
  * Returns: (transfer none) (element-type Gnt.TreeRow): The list of the rows.
- *          The list should not be modified by the caller.
+ *          The list should not be modified by the caller, and is only valid
+ *          until a row is added to, moved in, or removed from the tree.
  */
 GList *gnt_tree_get_rows(GntTree *tree);
 
@@ -330,6 +349,34 @@ void gnt_tree_remove(GntTree *tree, gpointer key);
  */
 void gnt_tree_remove_all(GntTree *tree);
 
+/**
+ * gnt_tree_begin_batch:
+ * @tree:  The tree
+ *
+ * Start a batch of changes to the tree. The tree is not redrawn until the
+ * matching call to gnt_tree_end_batch(). Rows added without a position while
+ * a compare function is set are not sorted as they are added; instead, each
+ * group of siblings they were added to is sorted once when the batch ends.
+ * This is useful when adding a lot of rows at once, for example when loading
+ * a buddy list.
+ *
+ * Batches can be nested.
+ *
+ * Since: 3.0.0
+ */
+void gnt_tree_begin_batch(GntTree *tree);
+
+/**
+ * gnt_tree_end_batch:
+ * @tree:  The tree
+ *
+ * End a batch of changes started with gnt_tree_begin_batch(). The rows are
+ * sorted and the tree is redrawn once the outermost batch ends.
+ *
+ * Since: 3.0.0
+ */
+void gnt_tree_end_batch(GntTree *tree);
+
 /**
  * gnt_tree_get_selection_visible_line:
  * @tree:  The tree
@@ -660,6 +707,52 @@ gboolean gnt_tree_is_searching(GntTree *tree);
  */
 void gnt_tree_set_search_function(GntTree *tree, GntTreeSearchFunc func);
 
+/**
+ * gnt_tree_get_search_match_count:
+ * @tree:  The tree
+ *
+ * Get the number of rows that are shown while the user is searching, i.e.
+ * the rows that match the search text and are not in collapsed rows.
+ *
+ * Returns: The number of matching rows shown, or -1 if the user is not
+ *          searching.
+ *
+ * Since: 3.0.0
+ */
+int gnt_tree_get_search_match_count(GntTree *tree);
+
+/**
+ * gnt_tree_set_virtual:
+ * @tree:   The tree
+ * @func:   (nullable): The function that gives the rows, or %NULL to turn
+ *          the virtual mode off.
+ * @data:   The data to pass to @func.
+ * @notify: (nullable): The function to free @data.
+ *
+ * Make the tree show a flat list of rows which are only created when they
+ * are on the screen, so it can show a very large list without keeping a row
+ * for each item. Set the number of rows with gnt_tree_set_virtual_count().
+ *
+ * All the rows in the tree are removed. A virtual tree can not have rows
+ * added to it, and it can not be searched, sorted or have child rows.
+ *
+ * Since: 3.0.0
+ */
+void gnt_tree_set_virtual(GntTree *tree, GntTreeVirtualFunc func,
+                          gpointer data, GDestroyNotify notify);
+
+/**
+ * gnt_tree_set_virtual_count:
+ * @tree:  The tree
+ * @count: The number of rows.
+ *
+ * Set the number of rows in a virtual tree. This also forgets the rows
+ * fetched so far, so call it whenever the rows change.
+ *
+ * Since: 3.0.0
+ */
+void gnt_tree_set_virtual_count(GntTree *tree, guint count);
+
 /**
  * gnt_tree_get_parent_key:
  * @tree:  The tree
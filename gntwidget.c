@@ -28,6 +28,8 @@
 #include "gntutils.h"
 
 #include "gntmainprivate.h"
+#include "gntwidgetprivate.h"
+#include "gntwmprivate.h"
 
 #define GNT_WIDGET_FLAGS(priv) (priv->flags)
 #define GNT_WIDGET_SET_FLAGS(priv, flags) (GNT_WIDGET_FLAGS(priv) |= flags)
@@ -66,6 +68,11 @@ typedef struct
 	gint minw, minh; /* Minimum size for the widget */
 
 	guint queue_update;
+
+	/* The part of the window that changed since it was last copied. It is
+	 * empty when x1 >= x2. */
+	gint damage_x1, damage_y1;
+	gint damage_x2, damage_y2;
 } GntWidgetPrivate;
 
 enum
@@ -373,8 +380,10 @@ update_queue_callback(gpointer data)
 	if (priv->queue_update == 0) {
 		return FALSE;
 	}
+	/* Only what was drawn through the widgets is copied, as they damage
+	 * what they draw. */
 	if (gnt_widget_get_mapped(widget)) {
-		gnt_screen_update(widget);
+		gnt_wm_update_damaged_window(gnt_wm_get_default(), widget);
 	}
 	priv->queue_update = 0;
 	return FALSE;
@@ -394,6 +403,112 @@ gnt_widget_queue_update(GntWidget *widget)
 		return;
 	}
 
+	gnt_widget_damage_all(widget);
+
+	toplevel = gnt_widget_get_toplevel(widget);
+	toplevel_priv = gnt_widget_get_instance_private(toplevel);
+
+	if (toplevel_priv->queue_update == 0) {
+		toplevel_priv->queue_update =
+		        g_timeout_add(0, update_queue_callback, toplevel);
+	}
+}
+
+void
+gnt_widget_damage(GntWidget *widget, gint x, gint y, gint width, gint height)
+{
+	GntWidgetPrivate *priv = NULL;
+	gint x2, y2;
+
+	g_return_if_fail(GNT_IS_WIDGET(widget));
+	priv = gnt_widget_get_instance_private(widget);
+
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+	x = MAX(x, 0);
+	y = MAX(y, 0);
+	x2 = (width > G_MAXINT - x) ? G_MAXINT : x + width;
+	y2 = (height > G_MAXINT - y) ? G_MAXINT : y + height;
+
+	if (priv->damage_x1 >= priv->damage_x2) {
+		priv->damage_x1 = x;
+		priv->damage_y1 = y;
+		priv->damage_x2 = x2;
+		priv->damage_y2 = y2;
+	} else {
+		priv->damage_x1 = MIN(priv->damage_x1, x);
+		priv->damage_y1 = MIN(priv->damage_y1, y);
+		priv->damage_x2 = MAX(priv->damage_x2, x2);
+		priv->damage_y2 = MAX(priv->damage_y2, y2);
+	}
+}
+
+/* All of the window changed, including whatever a window manager might have
+ * drawn outside the size of the widget. */
+void
+gnt_widget_damage_all(GntWidget *widget)
+{
+	gnt_widget_damage(widget, 0, 0, G_MAXINT, G_MAXINT);
+}
+
+gboolean
+gnt_widget_get_damage(GntWidget *widget, gint *x, gint *y, gint *width,
+                      gint *height)
+{
+	GntWidgetPrivate *priv = NULL;
+
+	g_return_val_if_fail(GNT_IS_WIDGET(widget), FALSE);
+	priv = gnt_widget_get_instance_private(widget);
+
+	if (priv->damage_x1 >= priv->damage_x2) {
+		return FALSE;
+	}
+	if (x) {
+		*x = priv->damage_x1;
+	}
+	if (y) {
+		*y = priv->damage_y1;
+	}
+	if (width) {
+		*width = priv->damage_x2 - priv->damage_x1;
+	}
+	if (height) {
+		*height = priv->damage_y2 - priv->damage_y1;
+	}
+	return TRUE;
+}
+
+void
+gnt_widget_clear_damage(GntWidget *widget)
+{
+	GntWidgetPrivate *priv = NULL;
+
+	g_return_if_fail(GNT_IS_WIDGET(widget));
+	priv = gnt_widget_get_instance_private(widget);
+
+	priv->damage_x1 = priv->damage_x2 = 0;
+	priv->damage_y1 = priv->damage_y2 = 0;
+}
+
+/* Like gnt_widget_queue_update, when only a part of the window changed. */
+void
+gnt_widget_queue_update_area(GntWidget *widget, gint x, gint y, gint width,
+                             gint height)
+{
+	GntWidgetPrivate *priv = NULL;
+	GntWidget *toplevel = NULL;
+	GntWidgetPrivate *toplevel_priv = NULL;
+
+	g_return_if_fail(GNT_IS_WIDGET(widget));
+	priv = gnt_widget_get_instance_private(widget);
+
+	if (priv->window == NULL) {
+		return;
+	}
+
+	gnt_widget_damage(widget, x, y, width, height);
+
 	toplevel = gnt_widget_get_toplevel(widget);
 	toplevel_priv = gnt_widget_get_instance_private(toplevel);
 
@@ -478,6 +593,8 @@ gnt_widget_draw(GntWidget *widget)
 		init_widget(widget);
 	}
 
+	/* Before drawing, so a box copies all of its children */
+	gnt_widget_damage_all(widget);
 	g_signal_emit(widget, signals[SIG_DRAW], 0);
 	gnt_widget_queue_update(widget);
 	gnt_widget_set_drawing(widget, FALSE);
@@ -636,6 +753,7 @@ init_widget(GntWidget *widget)
 
 	wbkgd(priv->window, gnt_color_pair(GNT_COLOR_NORMAL));
 	werase(priv->window);
+	gnt_widget_damage_all(widget);
 
 	if (gnt_widget_get_has_border(widget)) {
 		/* - This is ugly. */
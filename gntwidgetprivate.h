@@ -40,6 +40,19 @@ void gnt_widget_set_internal_size(GntWidget *widget, gint width, gint height);
 G_GNUC_INTERNAL
 void gnt_widget_queue_update(GntWidget *widget);
 
+/* The parts of the window of a widget that changed since it was last copied
+ * to its parent, or to the screen for a toplevel. */
+G_GNUC_INTERNAL
+void gnt_widget_damage(GntWidget *widget, gint x, gint y, gint width, gint height);
+G_GNUC_INTERNAL
+void gnt_widget_damage_all(GntWidget *widget);
+G_GNUC_INTERNAL
+gboolean gnt_widget_get_damage(GntWidget *widget, gint *x, gint *y, gint *width, gint *height);
+G_GNUC_INTERNAL
+void gnt_widget_clear_damage(GntWidget *widget);
+G_GNUC_INTERNAL
+void gnt_widget_queue_update_area(GntWidget *widget, gint x, gint y, gint width, gint height);
+
 G_END_DECLS
 
 #endif /* GNT_WIDGET_PRIVATE_H */
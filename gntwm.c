@@ -68,6 +68,7 @@
 #include "gntwsprivate.h"
 
 #define IDLE_CHECK_INTERVAL 5 /* 5 seconds */
+#define DEFAULT_MAX_FPS 60
 
 typedef struct
 {
@@ -81,6 +82,25 @@ typedef struct
 	GntWidget *tree;
 } GntListWindow;
 
+/* Where a panel is in the stack, to tell when the panels moved */
+typedef struct
+{
+	PANEL *panel;
+	WINDOW *window;
+	int x, y;
+	int width, height;
+} GntPanelPlace;
+
+/* A column of a panel right next to the edge of a panel above it, where a
+ * wide character may be cut in half. The coordinates are on the screen. */
+typedef struct
+{
+	PANEL *below;
+	int x;
+	int sy, ey;
+	gboolean left;  /* The column is left of the panel above */
+} GntWideCharEdge;
+
 typedef struct
 {
 	GMainLoop *loop;
@@ -115,6 +135,18 @@ typedef struct
 	GntKeyPressMode mode;
 
 	GHashTable *positions;
+
+	/* The screen is updated at most once per frame, see update_screen */
+	GntWM *wm;
+	guint frame_source;
+	gint64 frame_interval;   /* Shortest time between frames, in usec */
+	gint64 frame_time;       /* When the last frame was drawn */
+	GHashTable *dirty;       /* The windows to copy in the next frame */
+	GntWMFrameStats stats;
+
+	/* See work_around_for_ncurses_bug */
+	GArray *panel_places;    /* GntPanelPlace, top to bottom */
+	GArray *wide_char_edges; /* GntWideCharEdge */
 } GntWMPrivate;
 
 enum
@@ -155,6 +187,7 @@ static time_t last_active_time;
 static gboolean idle_update;
 static GList *act = NULL; /* list of WS with unseen activitiy */
 static gboolean ignore_keys = FALSE;
+static GntWM *default_wm = NULL;
 #ifdef USE_PYTHON
 static gboolean started_python = FALSE;
 #endif
@@ -175,11 +208,23 @@ void
 gnt_wm_copy_win(GntWidget *widget, GntNode *node)
 {
 	WINDOW *src, *dst;
+	gint x, y, width, height;
 	if (!node)
 		return;
 	src = gnt_widget_get_window(widget);
 	dst = node->window;
-	copywin(src, dst, node->scroll, 0, 0, 0, getmaxy(dst) - 1, getmaxx(dst) - 1, 0);
+
+	/* Only the part of the window that changed since the last copy */
+	if (gnt_widget_get_damage(widget, &x, &y, &width, &height)) {
+		int top = MAX(y - node->scroll, 0);
+		int bottom = MIN(y + height - node->scroll, getmaxy(dst));
+		int right = MIN(x + width, getmaxx(dst));
+		if (top < bottom && x < right) {
+			copywin(src, dst, top + node->scroll, x, top, x, bottom - 1,
+			        right - 1, 0);
+		}
+		gnt_widget_clear_damage(widget);
+	}
 
 	/* Update the hardware cursor */
 	if (GNT_IS_WINDOW(widget) || GNT_IS_BOX(widget)) {
@@ -206,16 +251,94 @@ gnt_wm_copy_win(GntWidget *widget, GntNode *node)
  * of the characters in that line get screwed. The workaround here is to erase
  * any such character preemptively.
  *
+ * The columns to look at only change when the panels move, so they are kept
+ * until then. In between, only the lines of the panels that changed since the
+ * last frame are looked at again.
+ *
  * Caveat: If a wide character is erased, and the panel above it is moved enough
  * to expose the entire character, it is not always redrawn.
  */
+#if NCURSES_WIDECHAR
+/* The erased character is copied from the widget again with the next frame,
+ * in case it is not covered anymore. */
 static void
-work_around_for_ncurses_bug(void)
+damage_panel_cell(PANEL *panel, int y, int x)
+{
+	const GntNode *node = panel_userptr(panel);
+	if (node && node->me)
+		gnt_widget_damage(node->me, x - 1, y + node->scroll, 3, 1);
+}
+
+static void
+erase_cut_wide_char(PANEL *below, int y, int x, gboolean left)
+{
+	WINDOW *window = panel_window(below);
+	cchar_t ch;
+	int w;
+
+	y -= getbegy(window);
+	x -= getbegx(window);
+	memset(&ch, 0, sizeof(ch));
+	if (mvwin_wch(window, y, x, &ch) != OK)
+		return;
+	w = widestringwidth(ch.chars);
+	if (w > 1 && (left ? (ch.attr & 1) : !(ch.attr & 1))) {
+		ch.chars[0] = ' ';
+		ch.attr &= ~ A_CHARTEXT;
+		mvwadd_wch(window, y, x, &ch);
+		touchline(window, y, 1);
+		damage_panel_cell(below, y, x);
+	}
+}
+
+static void
+add_wide_char_edge(GntWMPrivate *priv, PANEL *below, int x, int sy, int ey,
+                   gboolean left)
+{
+	GntWideCharEdge edge = {below, x, sy, ey, left};
+	g_array_append_val(priv->wide_char_edges, edge);
+}
+
+/* Find the edges again if any panel moved, was resized, or the stacking
+ * changed. Returns whether it did. */
+static gboolean
+find_wide_char_edges(GntWMPrivate *priv)
 {
-#if NCURSES_WIDECHAR
 	PANEL *panel = NULL;
+	guint count = 0;
+	gboolean moved = FALSE;
+
 	while ((panel = panel_below(panel)) != NULL) {
-		int sx, ex, sy, ey, w, y;
+		WINDOW *window = panel_window(panel);
+		GntPanelPlace place = {panel, window, getbegx(window), getbegy(window),
+		                       getmaxx(window), getmaxy(window)};
+		GntPanelPlace *old;
+
+		if (count < priv->panel_places->len) {
+			old = &g_array_index(priv->panel_places, GntPanelPlace, count);
+			if (old->panel != place.panel || old->window != place.window ||
+			    old->x != place.x || old->y != place.y ||
+			    old->width != place.width || old->height != place.height) {
+				*old = place;
+				moved = TRUE;
+			}
+		} else {
+			g_array_append_val(priv->panel_places, place);
+			moved = TRUE;
+		}
+		count++;
+	}
+	if (count != priv->panel_places->len) {
+		g_array_set_size(priv->panel_places, count);
+		moved = TRUE;
+	}
+	if (!moved)
+		return FALSE;
+
+	g_array_set_size(priv->wide_char_edges, 0);
+	panel = NULL;
+	while ((panel = panel_below(panel)) != NULL) {
+		int sx, ex, sy, ey, y1, y2;
 		PANEL *below = panel;
 
 		sx = getbegx(panel_window(panel));
@@ -224,35 +347,43 @@ work_around_for_ncurses_bug(void)
 		ey = getmaxy(panel_window(panel)) + sy;
 
 		while ((below = panel_below(below)) != NULL) {
-			if (sy > getbegy(panel_window(below)) + getmaxy(panel_window(below)) ||
-					ey < getbegy(panel_window(below)))
+			WINDOW *window = panel_window(below);
+			if (sy > getbegy(window) + getmaxy(window) ||
+					ey < getbegy(window))
 				continue;
-			if (sx > getbegx(panel_window(below)) + getmaxx(panel_window(below)) ||
-					ex < getbegx(panel_window(below)))
+			if (sx > getbegx(window) + getmaxx(window) ||
+					ex < getbegx(window))
 				continue;
-			for (y = MAX(sy, getbegy(panel_window(below))); y <= MIN(ey, getbegy(panel_window(below)) + getmaxy(panel_window(below))); y++) {
-				cchar_t ch;
-				memset(&ch, 0, sizeof(ch));
-				if (mvwin_wch(panel_window(below), y - getbegy(panel_window(below)), sx - 1 - getbegx(panel_window(below)), &ch) != OK)
-					goto right;
-				w = widestringwidth(ch.chars);
-				if (w > 1 && (ch.attr & 1)) {
-					ch.chars[0] = ' ';
-					ch.attr &= ~ A_CHARTEXT;
-					mvwadd_wch(panel_window(below), y - getbegy(panel_window(below)), sx - 1 - getbegx(panel_window(below)), &ch);
-					touchline(panel_window(below), y - getbegy(panel_window(below)), 1);
-				}
-right:
-				if (mvwin_wch(panel_window(below), y - getbegy(panel_window(below)), ex + 1 - getbegx(panel_window(below)), &ch) != OK)
-					continue;
-				w = widestringwidth(ch.chars);
-				if (w > 1 && !(ch.attr & 1)) {
-					ch.chars[0] = ' ';
-					ch.attr &= ~ A_CHARTEXT;
-					mvwadd_wch(panel_window(below), y - getbegy(panel_window(below)), ex + 1 - getbegx(panel_window(below)), &ch);
-					touchline(panel_window(below), y - getbegy(panel_window(below)), 1);
-				}
-			}
+			y1 = MAX(sy, getbegy(window));
+			y2 = MIN(ey, getbegy(window) + getmaxy(window));
+			add_wide_char_edge(priv, below, sx - 1, y1, y2, TRUE);
+			add_wide_char_edge(priv, below, ex + 1, y1, y2, FALSE);
+		}
+	}
+	return TRUE;
+}
+#endif
+
+static void
+work_around_for_ncurses_bug(G_GNUC_UNUSED GntWMPrivate *priv)
+{
+#if NCURSES_WIDECHAR
+	gboolean all = find_wide_char_edges(priv);
+	guint i;
+
+	for (i = 0; i < priv->wide_char_edges->len; i++) {
+		GntWideCharEdge *edge =
+		        &g_array_index(priv->wide_char_edges, GntWideCharEdge, i);
+		WINDOW *window = panel_window(edge->below);
+		int y;
+
+		/* Nothing changed in the panel since the last frame */
+		if (!all && !is_wintouched(window))
+			continue;
+
+		for (y = edge->sy; y <= edge->ey; y++) {
+			if (all || is_linetouched(window, y - getbegy(window)))
+				erase_cut_wide_char(edge->below, y, edge->x, edge->left);
 		}
 	}
 #endif
@@ -286,11 +417,41 @@ update_act_msg(void)
 	g_string_free(text, TRUE);
 }
 
+/* Copy the windows that changed since the last frame, and bring the
+ * terminal up to date. */
 static gboolean
-update_screen(GntWMPrivate *priv)
+draw_frame(gpointer data)
 {
+	GntWMPrivate *priv = data;
+	GHashTableIter iter;
+	GntWidget *widget;
+	gint64 start, elapsed;
+
+	priv->frame_source = 0;
 	if (priv->mode == GNT_KP_MODE_WAIT_ON_CHILD) {
-		return TRUE;
+		return FALSE;
+	}
+
+	start = g_get_monotonic_time();
+
+	g_hash_table_iter_init(&iter, priv->dirty);
+	while (g_hash_table_iter_next(&iter, (gpointer *)&widget, NULL)) {
+		GntNode *node = g_hash_table_lookup(priv->nodes, widget);
+		GntWS *ws = gnt_wm_widget_find_workspace(priv->wm, widget);
+		if (node == NULL || (ws != priv->cws &&
+		                     !gnt_widget_get_transient(widget))) {
+			continue;
+		}
+		if (!GNT_IS_MENU(widget)) {
+			gnt_box_sync_children(GNT_BOX(widget));
+		}
+		/* What this decorates is damaged with gnt_wm_damage_window */
+		g_signal_emit(priv->wm, signals[SIG_UPDATE_WIN], 0, node);
+		gnt_wm_copy_win(widget, node);
+	}
+	if (g_hash_table_size(priv->dirty) > 0) {
+		g_hash_table_remove_all(priv->dirty);
+		gnt_ws_draw_taskbar(priv->cws, FALSE);
 	}
 
 	if (priv->menu) {
@@ -302,10 +463,40 @@ update_screen(GntWMPrivate *priv)
 			top = gnt_menu_get_submenu(top);
 		}
 	}
-	work_around_for_ncurses_bug();
+	work_around_for_ncurses_bug(priv);
 	update_panels();
 	doupdate();
-	return TRUE;
+
+	priv->frame_time = g_get_monotonic_time();
+	elapsed = priv->frame_time - start;
+	priv->stats.frames++;
+	priv->stats.last_frame_time = elapsed;
+	priv->stats.total_frame_time += elapsed;
+	priv->stats.max_frame_time = MAX(priv->stats.max_frame_time, elapsed);
+	return FALSE;
+}
+
+/* Ask for the screen to be updated. Any number of updates in a row lead to a
+ * single frame, which is drawn once the main loop is idle, but no sooner than
+ * the frame rate allows. */
+static void
+update_screen(GntWMPrivate *priv)
+{
+	gint64 wait;
+
+	priv->stats.updates++;
+	if (priv->frame_source) {
+		return;
+	}
+
+	wait = priv->frame_time + priv->frame_interval - g_get_monotonic_time();
+	if (wait > 0) {
+		priv->frame_source =
+		        g_timeout_add((wait + 999) / 1000, draw_frame, priv);
+	} else {
+		priv->frame_source = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+		                                     draw_frame, priv, NULL);
+	}
 }
 
 static gboolean
@@ -442,6 +633,8 @@ static void
 gnt_wm_init(GntWM *wm)
 {
 	GntWMPrivate *priv = gnt_wm_get_instance_private(wm);
+	char *style;
+	int fps;
 
 	priv->name_places =
 	        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
@@ -460,6 +653,19 @@ gnt_wm_init(GntWM *wm)
 	if (gnt_style_get_bool(GNT_STYLE_REMPOS, TRUE)) {
 		read_window_positions(priv);
 	}
+	priv->wm = wm;
+	priv->dirty = g_hash_table_new(g_direct_hash, g_direct_equal);
+	priv->panel_places = g_array_new(FALSE, FALSE, sizeof(GntPanelPlace));
+	priv->wide_char_edges = g_array_new(FALSE, FALSE, sizeof(GntWideCharEdge));
+	style = gnt_style_get_from_name(NULL, "max-fps");
+	fps = style ? atoi(style) : DEFAULT_MAX_FPS;
+	g_free(style);
+	priv->frame_interval = fps > 0 ? G_USEC_PER_SEC / fps : 0;
+	/* Nobody is watching a headless screen, and its input script should
+	 * not get ahead of the frames. */
+	if (gnt_is_headless()) {
+		priv->frame_interval = 0;
+	}
 	g_timeout_add_seconds(IDLE_CHECK_INTERVAL, check_idle, NULL);
 	time(&last_active_time);
 	gnt_wm_switch_workspace(wm, 0);
@@ -566,6 +772,7 @@ window_scroll_up(GntBindable *bindable, G_GNUC_UNUSED GList *params)
 
 	if (node->scroll) {
 		node->scroll--;
+		gnt_widget_damage_all(window);
 		gnt_wm_copy_win(window, node);
 		update_screen(priv);
 	}
@@ -593,6 +800,7 @@ window_scroll_down(GntBindable *bindable, G_GNUC_UNUSED GList *params)
 	gnt_widget_get_size(window, &w, &h);
 	if (h - node->scroll > getmaxy(node->window)) {
 		node->scroll++;
+		gnt_widget_damage_all(window);
 		gnt_wm_copy_win(window, node);
 		update_screen(priv);
 	}
@@ -977,8 +1185,7 @@ shift_window(GntWMPrivate *priv, GntWidget *widget, int dir)
 		GntWidget *w = gnt_ws_get_top_widget(priv->cws);
 		GntNode *node = g_hash_table_lookup(priv->nodes, w);
 		top_panel(node->panel);
-		update_panels();
-		doupdate();
+		update_screen(priv);
 	}
 }
 
@@ -1150,6 +1357,7 @@ window_reverse(GntWidget *win, gboolean set, GntWMPrivate *priv)
 	for (i = 0; i < h; i += reverse_char(d, i, 0, set));
 	for (i = 0; i < h; i += reverse_char(d, i, w-1, set));
 
+	gnt_widget_damage_all(win);
 	gnt_wm_copy_win(win, g_hash_table_lookup(priv->nodes, win));
 	update_screen(priv);
 }
@@ -1522,6 +1730,20 @@ gnt_wm_destroy(GObject *obj)
 
 	g_clear_pointer(&priv->loop, g_main_loop_unref);
 
+	if (priv->frame_source) {
+		g_source_remove(priv->frame_source);
+		priv->frame_source = 0;
+	}
+	g_clear_pointer(&priv->dirty, g_hash_table_destroy);
+	if (priv->panel_places) {
+		g_array_free(priv->panel_places, TRUE);
+		priv->panel_places = NULL;
+	}
+	if (priv->wide_char_edges) {
+		g_array_free(priv->wide_char_edges, TRUE);
+		priv->wide_char_edges = NULL;
+	}
+
 #ifdef USE_PYTHON
 	if (started_python) {
 		Py_Finalize();
@@ -1974,6 +2196,7 @@ gnt_wm_new_window_real(GntWM *wm, GntWidget *widget)
 		w = MIN(w, maxx);
 		h = MIN(h, maxy);
 		node->window = newwin(h, w, y, x);
+		gnt_widget_damage_all(widget);
 		gnt_wm_copy_win(widget, node);
 	}
 #endif
@@ -2081,6 +2304,7 @@ void gnt_wm_window_close(GntWM *wm, GntWidget *widget)
 
 	g_signal_emit(wm, signals[SIG_CLOSE_WIN], 0, widget);
 	g_hash_table_remove(priv->nodes, widget);
+	g_hash_table_remove(priv->dirty, widget);
 
 	if (priv->windows) {
 		gnt_tree_remove(GNT_TREE(priv->windows->tree), widget);
@@ -2104,6 +2328,40 @@ void gnt_wm_window_close(GntWM *wm, GntWidget *widget)
 	update_screen(priv);
 }
 
+void
+gnt_wm_get_frame_stats(GntWM *wm, GntWMFrameStats *stats)
+{
+	GntWMPrivate *priv = NULL;
+
+	g_return_if_fail(GNT_IS_WM(wm));
+	g_return_if_fail(stats != NULL);
+	priv = gnt_wm_get_instance_private(wm);
+
+	*stats = priv->stats;
+}
+
+GntWM *
+gnt_wm_get_default(void)
+{
+	return default_wm;
+}
+
+void
+gnt_wm_damage_window(GntWM *wm, GntWidget *widget, int x, int y, int width,
+                     int height)
+{
+	g_return_if_fail(GNT_IS_WM(wm));
+	g_return_if_fail(GNT_IS_WIDGET(widget));
+
+	gnt_widget_damage(widget, x, y, width, height);
+}
+
+void
+gnt_wm_set_default(GntWM *wm)
+{
+	default_wm = wm;
+}
+
 time_t
 gnt_wm_get_idle_time(void)
 {
@@ -2385,7 +2643,29 @@ gnt_wm_give_focus(GntWM *wm, GntWidget *widget)
 	update_screen(priv);
 }
 
+/* Damage all of @widget, and of everything in it. */
+static void
+damage_all_children(GntWidget *widget)
+{
+	gnt_widget_damage_all(widget);
+	if (GNT_IS_BOX(widget)) {
+		GList *children = gnt_box_get_children(GNT_BOX(widget));
+		g_list_foreach(children, (GFunc)damage_all_children, NULL);
+		g_list_free(children);
+	}
+}
+
 void gnt_wm_update_window(GntWM *wm, GntWidget *widget)
+{
+	g_return_if_fail(GNT_IS_WM(wm));
+
+	/* The caller may have drawn anywhere in the window, without damaging
+	 * what it drew. */
+	damage_all_children(gnt_widget_get_toplevel(widget));
+	gnt_wm_update_damaged_window(wm, widget);
+}
+
+void gnt_wm_update_damaged_window(GntWM *wm, GntWidget *widget)
 {
 	GntWMPrivate *priv = NULL;
 	GntNode *node = NULL;
@@ -2395,21 +2675,29 @@ void gnt_wm_update_window(GntWM *wm, GntWidget *widget)
 	priv = gnt_wm_get_instance_private(wm);
 
 	widget = gnt_widget_get_toplevel(widget);
-	if (!GNT_IS_MENU(widget)) {
-		if (!GNT_IS_BOX(widget))
-			return;
-		gnt_box_sync_children(GNT_BOX(widget));
+	if (!GNT_IS_MENU(widget) && !GNT_IS_BOX(widget)) {
+		return;
 	}
 
 	ws = gnt_wm_widget_find_workspace(wm, widget);
 	node = g_hash_table_lookup(priv->nodes, widget);
+
+	if (node && (ws == priv->cws || gnt_widget_get_transient(widget))) {
+		/* The window is synced and copied once in the next frame */
+		g_hash_table_add(priv->dirty, widget);
+		update_screen(priv);
+		return;
+	}
+
+	if (!GNT_IS_MENU(widget)) {
+		gnt_box_sync_children(GNT_BOX(widget));
+	}
 	if (node == NULL) {
 		gnt_wm_new_window(wm, widget);
 	} else
 		g_signal_emit(wm, signals[SIG_UPDATE_WIN], 0, node);
 
 	if (ws == priv->cws || gnt_widget_get_transient(widget)) {
-		gnt_wm_copy_win(widget, node);
 		gnt_ws_draw_taskbar(priv->cws, FALSE);
 		update_screen(priv);
 	} else if (ws && ws != priv->cws && gnt_widget_get_is_urgent(widget)) {
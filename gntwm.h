@@ -59,6 +59,29 @@ typedef struct _GntNode
 	GntWS *ws;
 } GntNode;
 
+/**
+ * GntWMFrameStats:
+ * @frames: The number of frames drawn.
+ * @updates: The number of screen updates asked for. Updates that come in
+ *           before the next frame is drawn are merged into it.
+ * @last_frame_time: The time the last frame took to draw, in microseconds.
+ * @max_frame_time: The longest time a frame took to draw, in microseconds.
+ * @total_frame_time: The total time spent drawing frames, in microseconds.
+ *
+ * Statistics about the frames drawn by the window-manager. See
+ * gnt_wm_get_frame_stats().
+ *
+ * Since: 3.0.0
+ */
+typedef struct
+{
+	guint64 frames;
+	guint64 updates;
+	gint64 last_frame_time;
+	gint64 max_frame_time;
+	gint64 total_frame_time;
+} GntWMFrameStats;
+
 G_BEGIN_DECLS
 
 /**
@@ -86,6 +109,8 @@ G_DECLARE_DERIVABLE_TYPE(GntWM, gnt_wm, GNT, WM, GntBindable)
  *                 gets called when:
  *                 - the title of the window changes
  *                 - the 'urgency' of the window changes
+ *                 Anything it draws into the window has to be reported with
+ *                 gnt_wm_damage_window() to make it to the screen.
  * @key_pressed: This should usually return %NULL if the keys were processed by
  *               the WM. If not, the WM can simply return the original string,
  *               which will be processed by the default WM. The custom WM can
@@ -304,7 +329,8 @@ void gnt_wm_move_window(GntWM *wm, GntWidget *widget, int x, int y);
  * @wm:      The window-manager.
  * @widget:  The window to update.
  *
- * Update a window.
+ * Update a window. All of the window is copied to the screen, including
+ * anything drawn straight into the window of a widget in it.
  */
 void gnt_wm_update_window(GntWM *wm, GntWidget *widget);
 
@@ -317,6 +343,58 @@ void gnt_wm_update_window(GntWM *wm, GntWidget *widget);
  */
 void gnt_wm_raise_window(GntWM *wm, GntWidget *widget);
 
+/**
+ * gnt_wm_get_frame_stats:
+ * @wm:     The window-manager.
+ * @stats:  (out): Return location for the statistics.
+ *
+ * Get statistics about the frames drawn so far.
+ *
+ * The window-manager does not write to the terminal every time a window
+ * changes. The changes are collected, and drawn in a single frame once the
+ * main loop is idle. The number of frames per second is limited, by default
+ * to 60. The limit can be set in ~/.gntrc, where 0 means no limit:
+ *
+ * <programlisting>
+ * [general]
+ * max-fps = 30
+ * </programlisting>
+ *
+ * Since: 3.0.0
+ */
+void gnt_wm_get_frame_stats(GntWM *wm, GntWMFrameStats *stats);
+
+/**
+ * gnt_wm_get_default:
+ *
+ * Get the window-manager set up by #gnt_init.
+ *
+ * Returns: (transfer none) (nullable): The window-manager, or %NULL if GNT
+ *          is not initialized.
+ *
+ * Since: 3.0.0
+ */
+GntWM *gnt_wm_get_default(void);
+
+/**
+ * gnt_wm_damage_window:
+ * @wm:     The window-manager.
+ * @widget: The window.
+ * @x:      The column of the part that changed.
+ * @y:      The row of the part that changed.
+ * @width:  The width of the part that changed.
+ * @height: The height of the part that changed.
+ *
+ * Report that a part of a window was drawn outside of the widgets in it, for
+ * example by a window-manager decorating the window in its window_update
+ * callback. Only the parts of a window that changed are copied to the
+ * screen, which happens right after the window-update signal.
+ *
+ * Since: 3.0.0
+ */
+void gnt_wm_damage_window(GntWM *wm, GntWidget *widget, int x, int y,
+                          int width, int height);
+
 /**
  * gnt_wm_get_idle_time:
  *
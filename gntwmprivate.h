@@ -67,6 +67,32 @@ void gnt_wm_set_mainloop(GntWM *wm, GMainLoop *loop);
 G_GNUC_INTERNAL
 gboolean gnt_wm_is_list_window(GntWM *wm, GntWidget *widget);
 
+/*
+ * gnt_wm_set_default:
+ * @wm: The window-manager, or %NULL.
+ *
+ * Set the window-manager returned by gnt_wm_get_default().
+ *
+ * Internal.
+ */
+G_GNUC_INTERNAL
+void gnt_wm_set_default(GntWM *wm);
+
+/*
+ * gnt_wm_update_damaged_window:
+ * @wm:     The window-manager.
+ * @widget: The window to update.
+ *
+ * Update a window, copying only what its widgets damaged since the last
+ * update. This is what gnt_widget_queue_update() ends up in; use
+ * gnt_wm_update_window() or gnt_screen_update() for anything drawn without
+ * damaging it.
+ *
+ * Internal.
+ */
+G_GNUC_INTERNAL
+void gnt_wm_update_damaged_window(GntWM *wm, GntWidget *widget);
+
 G_GNUC_INTERNAL
 void gnt_wm_set_place_by_name(GntWM *wm, const gchar *name, GntWS *ws);
 G_GNUC_INTERNAL
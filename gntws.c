@@ -29,6 +29,7 @@
 #include "gntwm.h"
 #include "gntws.h"
 
+#include "gntwidgetprivate.h"
 #include "gntwmprivate.h"
 
 typedef struct
@@ -60,6 +61,7 @@ widget_show(gpointer data, gpointer nodes)
 	gnt_widget_set_visible(GNT_WIDGET(data), TRUE);
 	if (node) {
 		show_panel(node->panel);
+		gnt_widget_damage_all(GNT_WIDGET(data));
 		gnt_wm_copy_win(GNT_WIDGET(data), node);
 	}
 }
@@ -0,0 +1,69 @@
+/* Run a program on a headless screen with an input script, and check that
+ * the screen it leaves behind shows every line of the expected text.
+ *
+ * Usage: headless PROGRAM SCRIPT EXPECTED
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define SCREEN_FILE "headless.screen"
+
+int
+main(int argc, char **argv)
+{
+	gchar *child[] = {NULL, NULL};
+	gchar **envp, **lines;
+	gchar *dir, *screen = NULL, *expected = NULL;
+	GError *error = NULL;
+	gint status, i;
+	int ret = EXIT_SUCCESS;
+
+	if (argc != 4) {
+		fprintf(stderr, "Usage: %s PROGRAM SCRIPT EXPECTED\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* Keep the user's gntrc out of the test. */
+	dir = g_get_current_dir();
+	envp = g_get_environ();
+	envp = g_environ_setenv(envp, "XDG_CONFIG_HOME", dir, TRUE);
+	envp = g_environ_setenv(envp, "GNT_HEADLESS", "80x24", TRUE);
+	envp = g_environ_setenv(envp, "GNT_HEADLESS_INPUT", argv[2], TRUE);
+	envp = g_environ_setenv(envp, "GNT_HEADLESS_DUMP", SCREEN_FILE, TRUE);
+	g_free(dir);
+
+	g_unlink(SCREEN_FILE);
+	child[0] = argv[1];
+	if (!g_spawn_sync(NULL, child, envp, G_SPAWN_DEFAULT, NULL, NULL,
+	                  NULL, NULL, &status, &error) ||
+	    !g_spawn_check_exit_status(status, &error) ||
+	    !g_file_get_contents(SCREEN_FILE, &screen, NULL, &error) ||
+	    !g_file_get_contents(argv[3], &expected, NULL, &error)) {
+		fprintf(stderr, "%s: %s\n", argv[1], error->message);
+		g_error_free(error);
+		g_strfreev(envp);
+		g_free(screen);
+		return EXIT_FAILURE;
+	}
+
+	lines = g_strsplit(expected, "\n", -1);
+	for (i = 0; lines[i]; i++) {
+		if (*lines[i] && strstr(screen, lines[i]) == NULL) {
+			fprintf(stderr, "Not on the screen: %s\n", lines[i]);
+			ret = EXIT_FAILURE;
+		}
+	}
+	if (ret != EXIT_SUCCESS)
+		fprintf(stderr, "The screen was:\n%s", screen);
+
+	g_strfreev(lines);
+	g_strfreev(envp);
+	g_free(screen);
+	g_free(expected);
+
+	return ret;
+}
@@ -47,7 +47,7 @@ void gntwm_init(GntWM **wm);
 static void (*org_new_window)(GntWM *wm, GntWidget *win);
 
 static void
-envelope_main_window(GntWidget *win)
+envelope_main_window(GntWM *wm, GntWidget *win)
 {
 	WINDOW *window;
 	int w, h;
@@ -56,10 +56,11 @@ envelope_main_window(GntWidget *win)
 	wresize(window, h, w + 1);
 	mvwvline(window, 0, w, ACS_VLINE | COLOR_PAIR(GNT_COLOR_NORMAL), h);
 	touchwin(window);
+	gnt_wm_damage_window(wm, win, w, 0, 1, h);
 }
 
 static void
-envelope_normal_window(GntWidget *win)
+envelope_normal_window(GntWM *wm, GntWidget *win)
 {
 	WINDOW *window;
 	int w, h;
@@ -71,18 +72,19 @@ envelope_normal_window(GntWidget *win)
 	gnt_widget_get_size(win, &w, &h);
 	wbkgdset(window, ' ' | COLOR_PAIR(GNT_COLOR_NORMAL));
 	mvwprintw(window, 0, w - 4, "[X]");
+	gnt_wm_damage_window(wm, win, w - 4, 0, 3, 1);
 }
 
 static void
-s_decorate_window(G_GNUC_UNUSED GntWM *wm, GntWidget *win)
+s_decorate_window(GntWM *wm, GntWidget *win)
 {
 	const char *name;
 
 	name = gnt_widget_get_name(win);
 	if (name && strcmp(name, "MainWindow") == 0) {
-		envelope_main_window(win);
+		envelope_main_window(wm, win);
 	} else {
-		envelope_normal_window(win);
+		envelope_normal_window(wm, win);
 	}
 }
 